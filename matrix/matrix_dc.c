@@ -1,10 +1,15 @@
-/* Matrix multiplication, divide-and-conquer (O(n^3) time and O(n^3) space) */
+/* Matrix multiplication, divide-and-conquer (O(n^3) time and O(n^3) space)
+   The brute force size is matrix_dc_brute of the tuning file (../sort/tuning.h),
+   -T measures every power of 2 for the given n and writes the fastest. */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 
+#include "../sort/tuning.h"
+
 #define MAX_VAL			100
+#define TUNE_TRIALS		7
 #define BRUTE_SIZE_OPT	4
 
 struct _matrix {
@@ -13,7 +18,12 @@ struct _matrix {
 	int **data;
 };
 
+int _brute_size = BRUTE_SIZE_OPT;
+
 struct _matrix* _gen_rand_matrix(int);
+struct _matrix ***_alloc_cache(int, int*);
+void _free_cache(struct _matrix***, int);
+int _tune(struct _matrix*, struct _matrix*, struct _matrix*);
 void _mul_square_dc(struct _matrix*, struct _matrix*, int[4], int[4], struct _matrix*);
 void _mul_square_dc_cache(struct _matrix*, struct _matrix*, int[4], int[4], struct _matrix*, int, struct _matrix ***);
 void _mul_square_brute(struct _matrix *, struct _matrix *, int[4], int[4], struct _matrix *);
@@ -26,12 +36,28 @@ int main(int argc, char const *argv[])
 	// init random generator
 	srand(time(NULL));
 
-	if (argc < 2) {
-		printf("usage: matrix_dc 1024\n");
+	int n = 0, tune = 0;
+	while (--argc > 0) {
+		++argv;
+		if (**argv != '-') {
+			n = atoi(*argv);
+			continue;
+		}
+		switch (*++(*argv)) {
+			case 'T':
+				tune = 1;
+				break;
+			default:
+				printf("unknown option %s\n", *argv);
+				return 1;
+		}
+	}
+
+	if (n <= 0) {
+		printf("usage: matrix_dc [-T] 1024\n");
 		return 1;
 	}
 
-	int n = atoi(argv[1]);
 	if ((n & (n-1)) != 0) {
 		printf("matrix dimensions should be a power of 2\n");
 		return 1;
@@ -50,32 +76,13 @@ int main(int argc, char const *argv[])
 		mul->data[i] = (int *)malloc(n * sizeof(int));
 	}
 
-	// allocating multi-level caches for temporal calculations
-	int k = n;
-	int d = 0;
-	while (k > 0) {
-		k = k >> 1;
-		d++;
-		if (k <= BRUTE_SIZE_OPT) {
-			break;
-		}		
-	}
+	_brute_size = (int)_tuned("matrix_dc_brute", BRUTE_SIZE_OPT);
+	if (tune)
+		return _tune(m1, m2, mul);
 
-	struct _matrix ***cache = (struct _matrix ***)malloc(d * sizeof(struct _matrix**));
-	int j, p = n;
-	for (k = 0; k < d; k++) {
-		cache[k] = (struct _matrix **)malloc(8 * sizeof(struct _matrix*));
-		for (i = 0; i < 8; i++) {
-			cache[k][i] = (struct _matrix*)malloc(sizeof(struct _matrix));
-			cache[k][i]->rows = p/2;
-			cache[k][i]->cols = p/2;
-			cache[k][i]->data = (int **)malloc(p/2 * sizeof(int *));
-			for (j = 0; j < p/2; j++) {
-				cache[k][i]->data[j] = (int *)malloc(p/2 * sizeof(int));
-			}
-		}
-		p = p/2;
-	}
+	// allocating multi-level caches for temporal calculations
+	int d;
+	struct _matrix ***cache = _alloc_cache(n, &d);
 
 	int ind[4] = {0, n-1, 0, n-1};
 	_mul_square_dc_cache(m1, m2, ind, ind, mul, 0, cache);
@@ -89,14 +96,7 @@ int main(int argc, char const *argv[])
 	// _certify_mul(m1, m2, mul);
 
 	// de-allocate the cache
-	for (k = 0; k < d - 1; k++) {
-		for (i = 0; i < 8; i++) {
-			_free_matrix(cache[k][i]);
-			free(cache[k][i]);
-		}
-		free(cache[k]);
-	}
-	free(cache);
+	_free_cache(cache, d);
 
 	_free_matrix(m1);
 	_free_matrix(m2);
@@ -258,7 +258,7 @@ void _mul_square_dc_cache(struct _matrix *m1, struct _matrix *m2,
 		return;
 	}
 
-	if (n <= BRUTE_SIZE_OPT) {
+	if (n <= _brute_size) {
 		// using brute force algorithm for smaller dimensions
 		_mul_square_brute(m1, m2, ind1, ind2, res);
 		return;
@@ -336,4 +336,85 @@ struct _matrix* _gen_rand_matrix(int n) {
 	}
 
 	return res;
-}
\ No newline at end of file
+}
+
+/* multi-level caches for temporal calculations, d levels down to the brute force size */
+struct _matrix ***_alloc_cache(int n, int *d) {
+	int k = n;
+	*d = 0;
+	while (k > 0) {
+		k = k >> 1;
+		(*d)++;
+		if (k <= _brute_size) {
+			break;
+		}		
+	}
+
+	struct _matrix ***cache = (struct _matrix ***)malloc(*d * sizeof(struct _matrix**));
+	int i, j, p = n;
+	for (k = 0; k < *d; k++) {
+		cache[k] = (struct _matrix **)malloc(8 * sizeof(struct _matrix*));
+		for (i = 0; i < 8; i++) {
+			cache[k][i] = (struct _matrix*)malloc(sizeof(struct _matrix));
+			cache[k][i]->rows = p/2;
+			cache[k][i]->cols = p/2;
+			cache[k][i]->data = (int **)malloc(p/2 * sizeof(int *));
+			for (j = 0; j < p/2; j++) {
+				cache[k][i]->data[j] = (int *)malloc(p/2 * sizeof(int));
+			}
+		}
+		p = p/2;
+	}
+
+	return cache;
+}
+
+void _free_cache(struct _matrix ***cache, int d) {
+	int i, k;
+
+	for (k = 0; k < d; k++) {
+		for (i = 0; i < 8; i++) {
+			_free_matrix(cache[k][i]);
+			free(cache[k][i]);
+		}
+		free(cache[k]);
+	}
+	free(cache);
+}
+
+/* times the multiplication with every power of 2 brute force size, TUNE_TRIALS
+   samples each, and writes the size with the lowest median to the tuning file */
+int _tune(struct _matrix *m1, struct _matrix *m2, struct _matrix *mul) {
+	double t[TUNE_TRIALS];
+	double m, lo, hi, bm = 0;
+	int n = m1->rows;
+	int ind[4] = {0, n-1, 0, n-1};
+	int d, r, best = 0;
+	struct _matrix ***cache;
+
+	printf("brute size\tmedian, ms\t95%% ci\n");
+	for (_brute_size = 1; _brute_size <= n; _brute_size *= 2) {
+		cache = _alloc_cache(n, &d);
+		// the first run warms up the caches
+		for (r = -1; r < TUNE_TRIALS; r++) {
+			m = _now_ns();
+			_mul_square_dc_cache(m1, m2, ind, ind, mul, 0, cache);
+			if (r >= 0)
+				t[r] = (_now_ns() - m) / 1e6;
+		}
+		_free_cache(cache, d);
+
+		m = _median_ci(t, TUNE_TRIALS, &lo, &hi);
+		printf("%d\t\t%.3f\t\t%.3f-%.3f\n", _brute_size, m, lo, hi);
+		if (best == 0 || m < bm) {
+			best = _brute_size;
+			bm = m;
+		}
+	}
+
+	printf("matrix_dc_brute %d\n", best);
+	if (_tuning_set("matrix_dc_brute", best) != 0)
+		return 1;
+	printf("written to %s\n", _tuning_path());
+	return 0;
+}
@@ -0,0 +1,96 @@
+/* Converts an array between the text and the binary format of numio.h,
+   the input format is detected by the binary header.
+   Options: -b to convert to binary (default);
+   			-t to convert to text;
+   			-T u|l|f|d for uint32, int64, float or double numbers instead of ints.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "numio.h"
+
+#define CHUNK_LEN	(1 << 20)
+
+int main(int argc, char const *argv[])
+{
+	char to = 'b', type = 'i';
+
+	while (--argc > 0) {
+		++argv;
+		if (*(*argv)++ != '-')
+			continue;
+		switch (**argv) {
+			case 'b':
+			case 't':
+				to = **argv;
+				break;
+			case 'T':
+				// either -Tl or -T l
+				if (*++(*argv) == '\0' && argc > 1) {
+					--argc;
+					++argv;
+				}
+				type = **argv;
+				break;
+			default: 
+				printf("unknown option %s\n", *argv);
+				return 1;
+		}
+	}
+
+	int *arr;
+	void *typed;
+	long n, cap;
+	int k, owned;
+	uint32_t bin;
+
+	if (type != 'i') {
+		bin = type == 'u' ? BIN_UINT32 : type == 'l' ? BIN_INT64 : type == 'f' ? BIN_FLOAT32 :
+			type == 'd' ? BIN_FLOAT64 : 0;
+		if (bin == 0) {
+			printf("unknown element type %c\n", type);
+			return 1;
+		}
+		typed = _readall_typed(bin, &n, &owned);
+		if (to == 'b') {
+			_writebin_typed_hdr(n, bin);
+			_writebuf(typed, n * _bin_size(bin));
+		} else {
+			_writetyped(typed, n, bin);
+			_wr_flush();
+		}
+		return 0;
+	}
+
+	// a binary file is converted in place
+	arr = _readbin(&n);
+	if (arr == NULL) {
+		// the binary header needs the count, so read the whole array first
+		n = 0;
+		cap = CHUNK_LEN;
+		arr = (int *)malloc(cap * sizeof(int));
+		while ((k = _readnums(arr + n, (int)(cap - n))) > 0) {
+			n += k;
+			if (n == cap) {
+				cap *= 2;
+				arr = (int *)realloc(arr, cap * sizeof(int));
+			}
+		}
+	}
+
+	if (to == 'b') {
+		_writebin_hdr(n);
+		_writeraws(arr, n);
+	} else {
+		while (n > 0) {
+			k = n < CHUNK_LEN ? (int)n : CHUNK_LEN;
+			_writenums(arr, k);
+			arr += k;
+			n -= k;
+		}
+		_wr_flush();
+	}
+
+	return 0;
+}
@@ -1,56 +1,372 @@
-/* Binary search algorithm (on a sorted array from stdin) */
+/* Binary search algorithm (on a sorted array from stdin, text or binary).
+   Usage: bsearch 25 to search a single key;
+   		bsearch -q keys.txt for a batch of keys from a file, using an index of the
+   			array in the Eytzinger (BFS) layout, one answer per key:
+   			-s to use a static B+ tree (S-tree) of 16-key nodes instead;
+   			-m to use a learned index, linear models of the positions, instead;
+   			-f for the position of the key or -1 (default);
+   			-l for lower_bound, the position of the first number >= key;
+   			-u for upper_bound, the position of the first number > key;
+   			-c for the count of numbers equal to key (equal_range);
+   			-n to skip printing the answers, for benchmarking.
+   The batch mode prints the queries per second of the index and _bsearch to stderr.
+ */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <fcntl.h>
 #include <sys/time.h>
+#include <immintrin.h>
+
+#include "numio.h"
 
-#define MAX_BUF_LEN		12
 #define MAX_ARR_LEN 	10000000
+#define MAX_KEYS_LEN	100000000
+#define KEYS_CHUNK_LEN	(1 << 16) // first size of the key buffer, doubled as needed
+#define PREFETCH_STRIDE	16 // ints in a cache line, 4 levels of the tree ahead
+#define STREE_B			16 // keys in a node of the S-tree, a cache line
+#define STREE_BATCH		16 // queries descending the S-tree together
+#define LEARN_EPS		16 // max error of a position predicted by a segment
+#define LEARN_RADIX_BITS	16 // bits of the key prefixes mapped to the segments
+
+int _avx2;
 
-int _getnum();
 int _bsearch(int*, int, int);
 
+/* Eytzinger layout: b[1..n] is a complete binary tree in BFS order,
+   pos[k] is the position of b[k] in the sorted array */
+struct _eytz {
+	int n;
+	int *b;
+	int *pos;
+};
+
+struct _eytz *_eytz_build(int*, int);
+int _eytz_fill(struct _eytz*, int*, int, int);
+int _eytz_lower(struct _eytz*, int);
+int _eytz_upper(struct _eytz*, int);
+
+/* S-tree: a static B+ tree of STREE_B-key nodes stored layer by layer from the root,
+   a key of an internal node is the max of its child, the leaves are the sorted
+   array padded with INT_MAX */
+struct _stree {
+	int n;
+	int h;
+	int *cnt;		// nodes in a layer
+	int **layer;	// layer[0] is the root, layer[h - 1] are the leaves
+};
+
+struct _stree *_stree_build(int*, int);
+int _stree_rank(int*, int, int);
+int _stree_rank_avx2(int*, int, int);
+int _stree_search(struct _stree*, int, int);
+void _stree_batch(struct _stree*, int*, int, int*, int);
+
+/* learned index: the array split into segments, in each the position of the first
+   copy of a key is a linear function of the key within LEARN_EPS (PGM style),
+   the segment of a key is found with a table of the key prefixes (radix spline style) */
+struct _learn {
+	int n;
+	int *a;
+	int nseg;
+	int *x;			// first key of a segment
+	int *y;			// and its position
+	double *slope;
+	int shift;		// of a key minus x[0] to its prefix
+	int *table;		// first segment with a prefix >= the index
+	int maxerr;
+	long misses;	// lookups with the answer outside of the predicted window
+};
+
+struct _learn *_learn_build(int*, int);
+int _learn_predict(struct _learn*, int, int);
+int _learn_seg(struct _learn*, int);
+int _learn_lower(struct _learn*, int);
+int _learn_upper(struct _learn*, int);
+
+double _elapsed(struct timeval*, struct timeval*);
+
 int main(int argc, char const *argv[])
 {
-	if (argc == 1) {
+	const char *keysfile = NULL;
+	char op = 'f';
+	int output = 1;
+	char index = 'e';
+	int key = 0, haskey = 0;
+
+	while (--argc > 0) {
+		++argv;
+		if (**argv != '-' || (*argv)[1] == '\0' || ((*argv)[1] >= '0' && (*argv)[1] <= '9')) {
+			key = atoi(*argv);
+			haskey = 1;
+			continue;
+		}
+		switch (*++(*argv)) {
+			case 'q':
+				// either -qkeys.txt or -q keys.txt
+				if (*++(*argv) == '\0' && argc > 1) {
+					--argc;
+					++argv;
+				}
+				keysfile = *argv;
+				break;
+			case 'f':
+			case 'l':
+			case 'u':
+			case 'c':
+				op = **argv;
+				break;
+			case 'n':
+				output = 0;
+				break;
+			case 's':
+			case 'm':
+				index = **argv;
+				break;
+			default: 
+				printf("unknown option %s\n", *argv);
+				return 1;
+		}
+	}
+
+	if (!haskey && keysfile == NULL) {
 		printf("usage: bsearch 25");
 		return 1;
 	}
 
-	int key = atoi(argv[1]);
-
-	int *arr = (int *)malloc(MAX_ARR_LEN * sizeof(int));
+	int *arr;
 	int i = 0;
 	int lastnum, num;
+	long cnt;
 	lastnum = ~((~0u) >> 1);
 
-	// read an array from stdin
-	while ((num = _getnum()) != EOF && i < MAX_ARR_LEN) {
-		if (num < lastnum) {
-			printf("error: an array should be in a non-decreasing order");
-			return 1;
+	// a binary file is searched in place
+	arr = _readbin(&cnt);
+	if (arr != NULL) {
+		if (cnt > INT_MAX)
+			cnt = INT_MAX;
+		for (i = 1; i < cnt; i++) {
+			if (arr[i] < arr[i - 1]) {
+				printf("error: an array should be in a non-decreasing order");
+				return 1;
+			}
+		}
+		i = (int)cnt;
+	} else {
+		// read an array from stdin
+		arr = (int *)malloc(MAX_ARR_LEN * sizeof(int));
+		while (i < MAX_ARR_LEN && _readnum(&num)) {
+			if (num < lastnum) {
+				printf("error: an array should be in a non-decreasing order");
+				return 1;
+			}
+			arr[i++] = num;
+			lastnum = num;
 		}
-		arr[i++] = num;
-		lastnum = num;
 	}
 
-	// search the key in the array
 	struct timeval t1, t2;
 	double elapsed;
 
-	gettimeofday(&t1, NULL);
-	i = _bsearch(arr, i, key);
-	gettimeofday(&t2, NULL);
+	if (keysfile == NULL) {
+		// search the key in the array
+		gettimeofday(&t1, NULL);
+		i = _bsearch(arr, i, key);
+		gettimeofday(&t2, NULL);
+
+		elapsed = _elapsed(&t1, &t2);
+
+		if (i < 0) {
+			printf("the key %i could not be found in %fms\n", key, elapsed);
+			return 2;
+		}
+
+		printf("the key %i has been found at position %i in %fms\n", key, i, elapsed);
+
+		return 0;
+	}
+
+	// read the keys, text or binary, from the file
+	int n = i;
+	int fd = open(keysfile, O_RDONLY);
+	if (fd < 0) {
+		perror(keysfile);
+		return 1;
+	}
+	_rd_reset(fd);
+	int *keys, *res, *tmp;
+	int nkeys, kcap, k;
+
+	// a binary key file is used in place, text keys go to a buffer that grows
+	keys = _readbin(&cnt);
+	if (keys != NULL) {
+		nkeys = (int)(cnt < MAX_KEYS_LEN ? cnt : MAX_KEYS_LEN);
+	} else {
+		nkeys = 0;
+		kcap = KEYS_CHUNK_LEN;
+		keys = (int *)malloc(kcap * sizeof(int));
+		for (;;) {
+			if (keys == NULL) {
+				perror("malloc");
+				return 1;
+			}
+			nkeys += _readnums(keys + nkeys, kcap - nkeys);
+			if (nkeys < kcap || kcap == MAX_KEYS_LEN)
+				break;
+			kcap = 2 * kcap < MAX_KEYS_LEN ? 2 * kcap : MAX_KEYS_LEN;
+			keys = (int *)realloc((void *)keys, kcap * sizeof(int));
+		}
+		cnt = nkeys;
+		if (nkeys == MAX_KEYS_LEN && _readnum(&num))
+			cnt++;
+	}
+	if (cnt > MAX_KEYS_LEN) {
+		fprintf(stderr, "warning: only the first %d keys are searched\n", MAX_KEYS_LEN);
+	}
+	res = (int *)malloc((nkeys > 0 ? nkeys : 1) * sizeof(int));
+	if (res == NULL) {
+		perror("malloc");
+		return 1;
+	}
+
+	if (index == 's') {
+		_avx2 = __builtin_cpu_supports("avx2");
 
-	elapsed = (t2.tv_sec - t1.tv_sec) * 1000.0;     // sec to ms
-    elapsed += (t2.tv_usec - t1.tv_usec) / 1000.0;  // us to ms
+		gettimeofday(&t1, NULL);
+		struct _stree *t = _stree_build(arr, n);
+		gettimeofday(&t2, NULL);
+		fprintf(stderr, "s-tree of %d numbers and %d layers built in %fms\n", n, t->h, 
+			_elapsed(&t1, &t2));
+
+		// one key at a time, the answers are not used
+		gettimeofday(&t1, NULL);
+		k = 0;
+		for (i = 0; i < nkeys; i++) {
+			k += _stree_search(t, keys[i], op == 'u');
+		}
+		gettimeofday(&t2, NULL);
+		elapsed = _elapsed(&t1, &t2);
+		fprintf(stderr, "s-tree, one at a time: %d queries in %fms, %f Mq/s (checksum %d)\n", 
+			nkeys, elapsed, nkeys / elapsed / 1000.0, k);
+
+		// interleaved batches, the descents of a batch go down a layer together
+		gettimeofday(&t1, NULL);
+		_stree_batch(t, keys, nkeys, res, op == 'u');
+		switch (op) {
+			case 'f':
+				for (i = 0; i < nkeys; i++) {
+					if (res[i] == n || arr[res[i]] != keys[i])
+						res[i] = -1;
+				}
+				break;
+			case 'c':
+				tmp = (int *)malloc(nkeys * sizeof(int));
+				_stree_batch(t, keys, nkeys, tmp, 1);
+				for (i = 0; i < nkeys; i++) {
+					res[i] = tmp[i] - res[i];
+				}
+				free(tmp);
+				break;
+		}
+		gettimeofday(&t2, NULL);
+		elapsed = _elapsed(&t1, &t2);
+		fprintf(stderr, "s-tree, batches of %d: %d queries in %fms, %f Mq/s\n", STREE_BATCH, 
+			nkeys, elapsed, nkeys / elapsed / 1000.0);
+	} else if (index == 'm') {
+		gettimeofday(&t1, NULL);
+		struct _learn *m = _learn_build(arr, n);
+		gettimeofday(&t2, NULL);
+		fprintf(stderr, "learned index of %d numbers built in %fms: %d segments, %ld bytes, max error %d\n", 
+			n, _elapsed(&t1, &t2), m->nseg, 
+			m->nseg * (2 * sizeof(int) + sizeof(double)) + ((1L << LEARN_RADIX_BITS) + 1) * sizeof(int), 
+			m->maxerr);
 
-	if (i < 0) {
-		printf("the key %i could not be found in %fms\n", key, elapsed);
-		return 2;
+		gettimeofday(&t1, NULL);
+		switch (op) {
+			case 'f':
+				for (i = 0; i < nkeys; i++) {
+					k = _learn_lower(m, keys[i]);
+					res[i] = k < n && arr[k] == keys[i] ? k : -1;
+				}
+				break;
+			case 'l':
+				for (i = 0; i < nkeys; i++) {
+					res[i] = _learn_lower(m, keys[i]);
+				}
+				break;
+			case 'u':
+				for (i = 0; i < nkeys; i++) {
+					res[i] = _learn_upper(m, keys[i]);
+				}
+				break;
+			case 'c':
+				for (i = 0; i < nkeys; i++) {
+					res[i] = _learn_upper(m, keys[i]) - _learn_lower(m, keys[i]);
+				}
+				break;
+		}
+		gettimeofday(&t2, NULL);
+		elapsed = _elapsed(&t1, &t2);
+		fprintf(stderr, "learned: %d queries in %fms, %f Mq/s, %ld outside of the window\n", 
+			nkeys, elapsed, nkeys / elapsed / 1000.0, m->misses);
+	} else {
+		gettimeofday(&t1, NULL);
+		struct _eytz *e = _eytz_build(arr, n);
+		gettimeofday(&t2, NULL);
+		fprintf(stderr, "eytzinger layout of %d numbers built in %fms\n", n, _elapsed(&t1, &t2));
+
+		// answer the queries in a batch, independent descents overlap their cache misses
+		gettimeofday(&t1, NULL);
+		switch (op) {
+			case 'f':
+				for (i = 0; i < nkeys; i++) {
+					k = _eytz_lower(e, keys[i]);
+					res[i] = k != 0 && e->b[k] == keys[i] ? e->pos[k] : -1;
+				}
+				break;
+			case 'l':
+				for (i = 0; i < nkeys; i++) {
+					k = _eytz_lower(e, keys[i]);
+					res[i] = k != 0 ? e->pos[k] : n;
+				}
+				break;
+			case 'u':
+				for (i = 0; i < nkeys; i++) {
+					k = _eytz_upper(e, keys[i]);
+					res[i] = k != 0 ? e->pos[k] : n;
+				}
+				break;
+			case 'c':
+				for (i = 0; i < nkeys; i++) {
+					k = _eytz_upper(e, keys[i]);
+					res[i] = k != 0 ? e->pos[k] : n;
+					k = _eytz_lower(e, keys[i]);
+					res[i] -= k != 0 ? e->pos[k] : n;
+				}
+				break;
+		}
+		gettimeofday(&t2, NULL);
+		elapsed = _elapsed(&t1, &t2);
+		fprintf(stderr, "eytzinger: %d queries in %fms, %f Mq/s\n", nkeys, elapsed, 
+			nkeys / elapsed / 1000.0);
 	}
 
-	printf("the key %i has been found at position %i in %fms\n", key, i, elapsed);
+	// the same keys with the classic binary search, the answers are not used
+	gettimeofday(&t1, NULL);
+	k = 0;
+	for (i = 0; i < nkeys; i++) {
+		k += _bsearch(arr, n, keys[i]);
+	}
+	gettimeofday(&t2, NULL);
+	elapsed = _elapsed(&t1, &t2);
+	fprintf(stderr, "_bsearch: %d queries in %fms, %f Mq/s (checksum %d)\n", nkeys, elapsed, 
+		nkeys / elapsed / 1000.0, k);
+
+	if (output) {
+		_writenums(res, nkeys);
+		_wr_flush();
+	}
 
 	return 0;
 }
@@ -73,26 +389,317 @@ int _bsearch(int *a, int n, int k) {
 	return -1;
 }
 
-char _buf[MAX_BUF_LEN];
-int _getnum() {
-	int c;
-	char *ptr = _buf;
+struct _eytz *_eytz_build(int *a, int n) {
+	struct _eytz *e = (struct _eytz *)malloc(sizeof(struct _eytz));
+
+	// cache line aligned, so that the 16 grandchildren 4 levels down share a line
+	e->n = n;
+	e->b = (int *)aligned_alloc(64, ((n + 1) * sizeof(int) + 63) / 64 * 64);
+	e->pos = (int *)malloc((n + 1) * sizeof(int));
+	_eytz_fill(e, a, 0, 1);
+
+	return e;
+}
+
+/* in-order walk of the tree from the node k, takes a[i], a[i + 1], ...
+   and returns the position of the next number to take */
+int _eytz_fill(struct _eytz *e, int *a, int i, int k) {
+	if (k <= e->n) {
+		i = _eytz_fill(e, a, i, 2 * k);
+		e->b[k] = a[i];
+		e->pos[k] = i++;
+		i = _eytz_fill(e, a, i, 2 * k + 1);
+	}
+	return i;
+}
+
+/* node of the first number >= key, 0 when there is none */
+int _eytz_lower(struct _eytz *e, int key) {
+	int k = 1;
+
+	while (k <= e->n) {
+		__builtin_prefetch(e->b + (long)k * PREFETCH_STRIDE);
+		k = 2 * k + (e->b[k] < key);
+	}
+
+	// the path went right after the answer only, undo those turns and the last left one
+	k >>= __builtin_ffs(~k);
+	return k;
+}
+
+/* node of the first number > key, 0 when there is none */
+int _eytz_upper(struct _eytz *e, int key) {
+	int k = 1;
+
+	while (k <= e->n) {
+		__builtin_prefetch(e->b + (long)k * PREFETCH_STRIDE);
+		k = 2 * k + (e->b[k] <= key);
+	}
+
+	k >>= __builtin_ffs(~k);
+	return k;
+}
+
+struct _stree *_stree_build(int *a, int n) {
+	struct _stree *t = (struct _stree *)malloc(sizeof(struct _stree));
+	int c, h, l, i;
+
+	// nodes in the layers from the leaves up, a single leaf for an empty array
+	c = (n + STREE_B - 1) / STREE_B;
+	if (c == 0)
+		c = 1;
+	for (h = 1, i = c; i > 1; h++)
+		i = (i + STREE_B - 1) / STREE_B;
+
+	t->n = n;
+	t->h = h;
+	t->cnt = (int *)malloc(h * sizeof(int));
+	t->layer = (int **)malloc(h * sizeof(int *));
+	for (l = h - 1; l >= 0; l--) {
+		t->cnt[l] = c;
+		t->layer[l] = (int *)aligned_alloc(64, (long)c * STREE_B * sizeof(int));
+		c = (c + STREE_B - 1) / STREE_B;
+	}
+
+	// the leaves, then every key above is the last key of its child
+	memcpy((void *)t->layer[h - 1], (void *)a, (long)n * sizeof(int));
+	for (i = n; i < t->cnt[h - 1] * STREE_B; i++)
+		t->layer[h - 1][i] = INT_MAX;
+	for (l = h - 2; l >= 0; l--) {
+		for (i = 0; i < t->cnt[l] * STREE_B; i++) {
+			t->layer[l][i] = i < t->cnt[l + 1] ? t->layer[l + 1][i * STREE_B + STREE_B - 1] : INT_MAX;
+		}
+	}
+
+	return t;
+}
+
+/* keys of the node less than key, or not greater than key when upper */
+int _stree_rank(int *node, int key, int upper) {
+	int i, r = 0;
+
+	if (_avx2)
+		return _stree_rank_avx2(node, key, upper);
+
+	for (i = 0; i < STREE_B; i++) {
+		r += upper ? node[i] <= key : node[i] < key;
+	}
+	return r;
+}
+
+__attribute__((target("avx2")))
+int _stree_rank_avx2(int *node, int key, int upper) {
+	__m256i k, a, b;
+	unsigned m;
+
+	k = _mm256_set1_epi32(key);
+	a = _mm256_load_si256((__m256i *)node);
+	b = _mm256_load_si256((__m256i *)(node + 8));
+	if (upper) {
+		// node[i] > key, the rest are not greater
+		a = _mm256_cmpgt_epi32(a, k);
+		b = _mm256_cmpgt_epi32(b, k);
+		m = _mm256_movemask_ps(_mm256_castsi256_ps(a)) | _mm256_movemask_ps(_mm256_castsi256_ps(b)) << 8;
+		return STREE_B - __builtin_popcount(m);
+	}
+	a = _mm256_cmpgt_epi32(k, a);
+	b = _mm256_cmpgt_epi32(k, b);
+	m = _mm256_movemask_ps(_mm256_castsi256_ps(a)) | _mm256_movemask_ps(_mm256_castsi256_ps(b)) << 8;
+	return __builtin_popcount(m);
+}
+
+/* position of the first number >= key, or > key when upper, n when there is none */
+int _stree_search(struct _stree *t, int key, int upper) {
+	int l, k = 0;
+
+	for (l = 0; l < t->h; l++) {
+		k = k * STREE_B + _stree_rank(t->layer[l] + (long)k * STREE_B, key, upper);
+		// past the last node only when the key is greater than all of the numbers
+		if (l + 1 < t->h && k >= t->cnt[l + 1])
+			k = t->cnt[l + 1] - 1;
+	}
+
+	return k < t->n ? k : t->n;
+}
+
+/* searches n keys into res, STREE_BATCH of them go down the layers together
+   and prefetch their next nodes, so that the cache misses overlap */
+void _stree_batch(struct _stree *t, int *keys, int n, int *res, int upper) {
+	int i, j, l, m, k;
+
+	for (i = 0; i < n; i += STREE_BATCH) {
+		m = n - i < STREE_BATCH ? n - i : STREE_BATCH;
+		for (j = 0; j < m; j++)
+			res[i + j] = 0;
+		for (l = 0; l < t->h; l++) {
+			for (j = 0; j < m; j++) {
+				k = res[i + j];
+				k = k * STREE_B + _stree_rank(t->layer[l] + (long)k * STREE_B, keys[i + j], upper);
+				if (l + 1 < t->h) {
+					if (k >= t->cnt[l + 1])
+						k = t->cnt[l + 1] - 1;
+					__builtin_prefetch(t->layer[l + 1] + (long)k * STREE_B);
+				}
+				res[i + j] = k;
+			}
+		}
+		for (j = 0; j < m; j++) {
+			if (res[i + j] > t->n)
+				res[i + j] = t->n;
+		}
+	}
+}
+
+struct _learn *_learn_build(int *a, int n) {
+	struct _learn *m = (struct _learn *)malloc(sizeof(struct _learn));
+	double lo, hi, dx, l, h;
+	long range;
+	int i, j, s, b, e;
+
+	m->n = n;
+	m->a = a;
+	m->x = (int *)malloc((n + 1) * sizeof(int));
+	m->y = (int *)malloc((n + 1) * sizeof(int));
+	m->slope = (double *)malloc((n + 1) * sizeof(double));
+	m->table = (int *)malloc(((1 << LEARN_RADIX_BITS) + 1) * sizeof(int));
+	m->nseg = 0;
+	m->maxerr = 0;
+	m->misses = 0;
+
+	// shrinking cone: extend a segment while a slope through its first point keeps
+	// every first copy of a key within LEARN_EPS of its position
+	i = 0;
+	while (i < n) {
+		s = m->nseg++;
+		m->x[s] = a[i];
+		m->y[s] = i;
+		lo = 0.0;
+		hi = 1e300;
+		for (j = i + 1; j < n; j++) {
+			if (a[j] == a[j - 1])
+				continue;
+			dx = (double)((long)a[j] - a[i]);
+			l = (j - LEARN_EPS - i) / dx;
+			h = (j + LEARN_EPS - i) / dx;
+			if (l > hi || h < lo)
+				break;
+			lo = l > lo ? l : lo;
+			hi = h < hi ? h : hi;
+		}
+		m->slope[s] = hi == 1e300 ? 0.0 : (lo + hi) / 2;
+
+		// the error actually made, with the rounding of the lookups
+		for (; i < j; i++) {
+			if (i > 0 && a[i] == a[i - 1])
+				continue;
+			e = _learn_predict(m, s, a[i]) - i;
+			e = e < 0 ? -e : e;
+			if (e > m->maxerr)
+				m->maxerr = e;
+		}
+	}
+
+	// the shift that fits the range of the keys into the table
+	range = n > 0 ? (long)a[n - 1] - a[0] : 0;
+	m->shift = 0;
+	while ((range >> m->shift) >= (1L << LEARN_RADIX_BITS))
+		m->shift++;
+	for (b = 0, s = 0; b <= (1 << LEARN_RADIX_BITS); b++) {
+		while (s < m->nseg && (((long)m->x[s] - m->x[0]) >> m->shift) < b)
+			s++;
+		m->table[b] = s;
+	}
+
+	return m;
+}
+
+/* position of the key predicted by the segment s */
+int _learn_predict(struct _learn *m, int s, int key) {
+	long p;
+
+	p = m->y[s] + (long)(m->slope[s] * ((long)key - m->x[s]) + 0.5);
+	return p < 0 ? 0 : p > m->n ? m->n : (int)p;
+}
+
+/* last segment with the first key <= key, the first one for smaller keys */
+int _learn_seg(struct _learn *m, int key) {
+	long b;
+	int lo, hi, mid;
 
-	// skip spaces until we get a start of a new number
-	for (c = getchar(); c == '\n' || c == ' '; c = getchar());
+	if (key <= m->x[0])
+		return 0;
+	b = ((long)key - m->x[0]) >> m->shift;
+	if (b >= (1L << LEARN_RADIX_BITS))
+		b = (1L << LEARN_RADIX_BITS) - 1;
 
-	// read chars of a number
-	while (c != EOF && c != '\n' && c != ' ' 
-		&& ptr < _buf + MAX_BUF_LEN - 1) {
-		*ptr++ = c;
-		c = getchar();
+	// the segments of the prefix and the last one before them
+	lo = m->table[b] - 1;
+	lo = lo < 0 ? 0 : lo;
+	hi = m->table[b + 1] - 1;
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (m->x[mid] <= key)
+			lo = mid;
+		else
+			hi = mid - 1;
 	}
 
-	*ptr = '\0';
+	return lo;
+}
+
+/* position of the first number >= key, n when there is none */
+int _learn_lower(struct _learn *m, int key) {
+	int *a = m->a;
+	int n = m->n;
+	int p, lo, hi, step, len, half;
+
+	if (n == 0)
+		return 0;
 
-	if (ptr == _buf && c == EOF) {
-		return EOF;
+	p = _learn_predict(m, _learn_seg(m, key), key);
+	lo = p - m->maxerr;
+	lo = lo < 0 ? 0 : lo;
+	hi = p + m->maxerr + 1;
+	hi = hi > n ? n : hi;
+
+	// a key missing from the array, or after many copies of a smaller one, can be
+	// predicted off the window, then gallop from it to a range with the answer
+	if ((lo > 0 && a[lo - 1] >= key) || (hi < n && a[hi] < key)) {
+		m->misses++;
+		step = hi - lo + 1;
+		while (lo > 0 && a[lo - 1] >= key) {
+			hi = lo;
+			step *= 2;
+			lo = hi - step < 0 ? 0 : hi - step;
+		}
+		while (hi < n && a[hi] < key) {
+			lo = hi + 1;
+			step *= 2;
+			hi = lo + step > n ? n : lo + step;
+		}
 	}
 
-	return atoi(_buf);
-}
\ No newline at end of file
+	// the answer is in [lo, hi], search a[lo..hi) without branches
+	len = hi - lo;
+	if (len == 0)
+		return lo;
+	while (len > 1) {
+		half = len / 2;
+		lo = a[lo + half] < key ? lo + half : lo;
+		len -= half;
+	}
+	return lo + (a[lo] < key);
+}
+
+/* position of the first number > key, n when there is none */
+int _learn_upper(struct _learn *m, int key) {
+	return key == INT_MAX ? m->n : _learn_lower(m, key + 1);
+}
+
+double _elapsed(struct timeval *t1, struct timeval *t2) {
+	double elapsed;
+
+	elapsed = (t2->tv_sec - t1->tv_sec) * 1000.0;     // sec to ms
+	elapsed += (t2->tv_usec - t1->tv_usec) / 1000.0;  // us to ms
+	return elapsed;
+}
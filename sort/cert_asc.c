@@ -1,55 +1,339 @@
-/* Certifies that an input array is in the ascending order */
+/* Certifies that an input array is in the ascending order, text or binary.
+   Usage: cert_asc < sorted.txt
+   		-i input.txt to also certify that the array is a permutation of the input,
+   			the counts and order-independent multiset hashes of both are compared;
+   		-j N threads for a binary array, the number of cores by default;
+   		-t to print the time.
+   A binary array is checked in place, split across the threads, 8 numbers at a time
+   with AVX2, the order and the hash in the same pass. Build with -pthread.
+ */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <immintrin.h>
 
-#define MAX_BUF_LEN 12
+#include "numio.h"
 
-int _getnum();
+#define HASH_SEED1		0x9e3779b9u
+#define HASH_SEED2		0x7f4a7c15u
+#define PARALLEL_LEN	(1 << 20) // smaller arrays are checked by a single thread
+
+/* multiset hash: the count and the sums of two hashes of the numbers, in any order */
+struct _mhash {
+	long n;
+	uint64_t h1, h2;
+};
+
+/* a part a[p..r) of an array checked by a thread, bad is the position of
+   the first number less than the previous one, or -1 */
+struct _cpart {
+	int *a;
+	long p, r;
+	int order;
+	long bad;
+	struct _mhash h;
+};
+
+int _avx2;
+int _nthreads = 0;
+
+/* hashing */
+static inline uint32_t _mix(uint32_t, uint32_t);
+static inline void _mhash_add(struct _mhash*, int);
+
+/* checking of an array */
+void _cert_array(int*, long, int, struct _cpart*);
+void *_cert_run(void*);
+void _cert_part(struct _cpart*);
+void _cert_part_avx2(struct _cpart*);
+int _cert_file(const char*, struct _mhash*);
 
 int main(int argc, char const *argv[])
 {
-	int lastnum, num, n;
-
-	// read an array from stdin
-	n = 0;
-	while ((num = _getnum()) != EOF) {
-		n++;
-		if (num < lastnum) {
-			printf("non-decreasing order is not satisfied at the number %d.\n", num);
+	const char *infile = NULL;
+	int timing = 0;
+	int lastnum, num;
+	int *arr;
+	long n;
+	struct _cpart c;
+	struct _mhash in;
+	struct timeval t1, t2;
+	double elapsed;
+
+	while (--argc > 0) {
+		++argv;
+		if (*(*argv)++ != '-')
+			continue;
+		switch (**argv) {
+			case 'i':
+				// either -iinput.txt or -i input.txt
+				if (*++(*argv) == '\0' && argc > 1) {
+					--argc;
+					++argv;
+				}
+				infile = *argv;
+				break;
+			case 'j':
+				if (*++(*argv) == '\0' && argc > 1) {
+					--argc;
+					++argv;
+				}
+				_nthreads = atoi(*argv);
+				if (_nthreads <= 0) {
+					printf("number of threads must be a positive number.\n");
+					return 1;
+				}
+				break;
+			case 't':
+				timing = 1;
+				break;
+			default:
+				printf("unknown option %s\n", *argv);
+				return 1;
+		}
+	}
+
+	_avx2 = __builtin_cpu_supports("avx2");
+	if (_nthreads <= 0) {
+		_nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if (_nthreads <= 0)
+			_nthreads = 1;
+	}
+
+	gettimeofday(&t1, NULL);
+
+	// a binary file is checked in place
+	arr = _readbin(&n);
+	if (arr != NULL) {
+		_cert_array(arr, n, 1, &c);
+		if (c.bad >= 0) {
+			printf("non-decreasing order is not satisfied at the number %d.\n", arr[c.bad]);
 			return 1;
 		}
+	} else {
+		// read an array from stdin
+		c.h.n = 0;
+		c.h.h1 = c.h.h2 = 0;
+		lastnum = ~((~0u) >> 1);
+		while (_readnum(&num)) {
+			_mhash_add(&c.h, num);
+			if (num < lastnum) {
+				printf("non-decreasing order is not satisfied at the number %d.\n", num);
+				return 1;
+			}
 
-		lastnum = num;
+			lastnum = num;
+		}
+		n = c.h.n;
 	}
 
 	printf(
-		"non-decreasing order of an array of size %d has been successfully certified.\n", 
+		"non-decreasing order of an array of size %ld has been successfully certified.\n",
 		n);
 
+	if (infile != NULL) {
+		if (_cert_file(infile, &in) != 0)
+			return 1;
+		if (in.n != c.h.n || in.h1 != c.h.h1 || in.h2 != c.h.h2) {
+			printf("the array is not a permutation of the input: %ld numbers, %ld in the input%s.\n",
+				c.h.n, in.n, in.n == c.h.n ? ", the hashes differ" : "");
+			return 1;
+		}
+		printf("the array is a permutation of the input of size %ld.\n", in.n);
+	}
+
+	gettimeofday(&t2, NULL);
+	if (timing) {
+		elapsed = (t2.tv_sec - t1.tv_sec) * 1000.0;     // sec to ms
+		elapsed += (t2.tv_usec - t1.tv_usec) / 1000.0;  // us to ms
+		fprintf(stderr, "certified in %fms\n", elapsed);
+	}
+
 	return 0;
 }
 
-char _buf[MAX_BUF_LEN];
-int _getnum() {
-	int c;
-	char *ptr = _buf;
+/* murmur3 finalizer of x and a seed */
+static inline uint32_t _mix(uint32_t x, uint32_t seed) {
+	x ^= seed;
+	x ^= x >> 16;
+	x *= 0x85ebca6bu;
+	x ^= x >> 13;
+	x *= 0xc2b2ae35u;
+	x ^= x >> 16;
+	return x;
+}
+
+static inline void _mhash_add(struct _mhash *h, int num) {
+	h->n++;
+	h->h1 += _mix((uint32_t)num, HASH_SEED1);
+	h->h2 += _mix((uint32_t)num, HASH_SEED2);
+}
+
+/* checks the order of a[0..n), when order is set, and hashes it into c,
+   split across _nthreads threads */
+void _cert_array(int *a, long n, int order, struct _cpart *c) {
+	struct _cpart *parts;
+	pthread_t *threads;
+	long len;
+	int k, i;
 
-	// skip spaces until we get a start of a new number
-	for (c = getchar(); c == '\n' || c == ' '; c = getchar());
+	k = n < PARALLEL_LEN ? 1 : _nthreads;
+	parts = (struct _cpart *)malloc(k * sizeof(struct _cpart));
+	threads = (pthread_t *)malloc(k * sizeof(pthread_t));
 
-	// read chars of a number
-	while (c != EOF && c != '\n' && c != ' ' 
-		&& ptr < _buf + MAX_BUF_LEN - 1) {
-		*ptr++ = c;
-		c = getchar();
+	len = (n + k - 1) / k;
+	for (i = 0; i < k; i++) {
+		parts[i].a = a;
+		parts[i].p = i * len < n ? i * len : n;
+		parts[i].r = (i + 1) * len < n ? (i + 1) * len : n;
+		parts[i].order = order;
 	}
+	for (i = 1; i < k; i++) {
+		pthread_create(&threads[i], NULL, _cert_run, (void *)&parts[i]);
+	}
+	_cert_run((void *)&parts[0]);
+
+	// the first violation and the sums of the parts
+	c->bad = -1;
+	c->h.n = 0;
+	c->h.h1 = c->h.h2 = 0;
+	for (i = 0; i < k; i++) {
+		if (i > 0)
+			pthread_join(threads[i], NULL);
+		if (c->bad < 0)
+			c->bad = parts[i].bad;
+		c->h.n += parts[i].h.n;
+		c->h.h1 += parts[i].h.h1;
+		c->h.h2 += parts[i].h.h2;
+	}
+
+	free(parts);
+	free(threads);
+}
 
-	*ptr = '\0';
+void *_cert_run(void *arg) {
+	struct _cpart *c = (struct _cpart *)arg;
 
-	if (ptr == _buf && c == EOF) {
-		return EOF;
+	c->bad = -1;
+	c->h.n = 0;
+	c->h.h1 = c->h.h2 = 0;
+	if (_avx2) {
+		_cert_part_avx2(c);
+	} else {
+		_cert_part(c);
 	}
+	return NULL;
+}
+
+void _cert_part(struct _cpart *c) {
+	long i;
+
+	for (i = c->p; i < c->r; i++) {
+		if (c->order && i > 0 && c->a[i] < c->a[i - 1]) {
+			c->bad = i;
+			return;
+		}
+		_mhash_add(&c->h, c->a[i]);
+	}
+}
+
+/* 8 numbers compared with their predecessors and hashed at a time,
+   the sums of the hashes are kept in 64-bit lanes */
+__attribute__((target("avx2")))
+void _cert_part_avx2(struct _cpart *c) {
+	__m256i v, x, acc1, acc2, s1, s2, m1, m2;
+	uint64_t h[4];
+	int *a = c->a;
+	long i, r;
+
+	acc1 = acc2 = _mm256_setzero_si256();
+	s1 = _mm256_set1_epi32((int)HASH_SEED1);
+	s2 = _mm256_set1_epi32((int)HASH_SEED2);
+	m1 = _mm256_set1_epi32((int)0x85ebca6bu);
+	m2 = _mm256_set1_epi32((int)0xc2b2ae35u);
+
+	// the first number has no predecessor
+	i = c->p;
+	if (i == 0 && c->r > 0) {
+		_mhash_add(&c->h, a[0]);
+		i = 1;
+	}
+
+	for (r = c->r - 8; i <= r; i += 8) {
+		v = _mm256_loadu_si256((__m256i *)(a + i));
+		if (c->order) {
+			x = _mm256_cmpgt_epi32(_mm256_loadu_si256((__m256i *)(a + i - 1)), v);
+			if (!_mm256_testz_si256(x, x)) {
+				c->bad = i + __builtin_ctz(_mm256_movemask_ps(_mm256_castsi256_ps(x)));
+				return;
+			}
+		}
+
+		x = _mm256_xor_si256(v, s1);
+		x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+		x = _mm256_mullo_epi32(x, m1);
+		x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 13));
+		x = _mm256_mullo_epi32(x, m2);
+		x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+		acc1 = _mm256_add_epi64(acc1, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(x)));
+		acc1 = _mm256_add_epi64(acc1, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(x, 1)));
+
+		x = _mm256_xor_si256(v, s2);
+		x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+		x = _mm256_mullo_epi32(x, m1);
+		x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 13));
+		x = _mm256_mullo_epi32(x, m2);
+		x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+		acc2 = _mm256_add_epi64(acc2, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(x)));
+		acc2 = _mm256_add_epi64(acc2, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(x, 1)));
 
-	return atoi(_buf);
-}
\ No newline at end of file
+		c->h.n += 8;
+	}
+
+	_mm256_storeu_si256((__m256i *)h, acc1);
+	c->h.h1 += h[0] + h[1] + h[2] + h[3];
+	_mm256_storeu_si256((__m256i *)h, acc2);
+	c->h.h2 += h[0] + h[1] + h[2] + h[3];
+
+	// the tail
+	for (; i < c->r; i++) {
+		if (c->order && c->a[i] < c->a[i - 1]) {
+			c->bad = i;
+			return;
+		}
+		_mhash_add(&c->h, a[i]);
+	}
+}
+
+/* hashes the numbers of the file path, in place when it is binary */
+int _cert_file(const char *path, struct _mhash *h) {
+	struct _cpart c;
+	int *arr;
+	long n;
+	int fd, num;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return 1;
+	}
+	_rd_reset(fd);
+
+	arr = _readbin(&n);
+	if (arr != NULL) {
+		_cert_array(arr, n, 0, &c);
+		*h = c.h;
+		return 0;
+	}
+
+	h->n = 0;
+	h->h1 = h->h2 = 0;
+	while (_readnum(&num))
+		_mhash_add(h, num);
+	return 0;
+}
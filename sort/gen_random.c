@@ -1,29 +1,297 @@
-/* Generate a pseudo-random uint array with values between 0 and RAND_MAX 
-and print it to stdout */
+/* Generate a pseudo-random int array with values between 0 and RAND_MAX
+and print it to stdout.
+   Usage: gen_random [options] 1000000
+   		-Du uniform (default), -Ds sorted, -Dr reverse-sorted, -Dn nearly sorted
+   			(k random swaps of a sorted array), -Df few unique (k distinct values),
+   			-Dz zipfian (over k ranks, the rank 0 is the most frequent),
+   			-Do organ-pipe (ascending, then descending);
+   		-k N the parameter of -Dn, -Df and -Dz;
+   		-s N the seed (1 by default), the output depends only on the seed and the options;
+   		-j N threads, the number of cores by default;
+   		-b to print it in the binary format of numio.h.
+   The numbers come from a counter-based generator (splitmix64 of the seed and the
+   position), so blocks of the array are generated by the threads independently,
+   and written in order while the next blocks are generated. Build with -pthread.
+ */
 
-#include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "numio.h"
+
+#define BLOCK_LEN		(1 << 20) // numbers generated by a thread at a time
+#define VALUE_RANGE		((uint64_t)RAND_MAX + 1)
+#define SWAPS_DIV		1000 // n / SWAPS_DIV swaps of -Dn by default
+#define FEW_UNIQUE		16
+#define ZIPF_RANKS		1000000
+#define GOLDEN			0x9e3779b97f4a7c15ull
+
+/* a block of the array, p..r, generated into nums or formatted into text */
+struct _block {
+	long p, r;
+	int *nums;
+	char *text;
+	long len;
+};
+
+long _n;
+uint64_t _seed = 1;
+char _dist = 'u';
+long _k = 0;
+int _binary = 0;
+int _nthreads = 0;
+
+// -Dn: the positions moved by the swaps, sorted, and where their numbers come from
+long *_swap_pos, *_swap_src;
+long _nswap = 0;
+
+/* generation */
+static inline uint64_t _hash(uint64_t, uint64_t);
+static inline int _sorted_num(long);
+void _swaps_build();
+int _cmp_long(const void*, const void*);
+void *_gen_run(void*);
 
 int main(int argc, char const *argv[])
 {
-	if (argc < 2) {
-		printf("usage: gen_random 1000000\n");
-		return 1;
+	struct _block *blocks[2];
+	pthread_t *threads;
+	long p;
+	int i, t, cur, prev;
+
+	_n = 0;
+	while (--argc > 0) {
+		++argv;
+		if (**argv != '-') {
+			_n = atol(*argv);
+			continue;
+		}
+		switch (*++(*argv)) {
+			case 'b':
+				_binary = 1;
+				break;
+			case 'D':
+				_dist = *++(*argv);
+				if (_dist != 'u' && _dist != 's' && _dist != 'r' && _dist != 'n' && _dist != 'f'
+					&& _dist != 'z' && _dist != 'o') {
+					printf("unknown distribution %c\n", _dist);
+					return 1;
+				}
+				break;
+			case 'k':
+				// either -k16 or -k 16
+				if (*++(*argv) == '\0' && argc > 1) {
+					--argc;
+					++argv;
+				}
+				_k = atol(*argv);
+				if (_k <= 0) {
+					printf("k must be a positive number.\n");
+					return 1;
+				}
+				break;
+			case 's':
+				if (*++(*argv) == '\0' && argc > 1) {
+					--argc;
+					++argv;
+				}
+				_seed = strtoull(*argv, NULL, 10);
+				break;
+			case 'j':
+				if (*++(*argv) == '\0' && argc > 1) {
+					--argc;
+					++argv;
+				}
+				_nthreads = atoi(*argv);
+				if (_nthreads <= 0) {
+					printf("number of threads must be a positive number.\n");
+					return 1;
+				}
+				break;
+			default:
+				printf("unknown option %s\n", *argv);
+				return 1;
+		}
 	}
 
-	int num = atoi(argv[1]);
-	if (num <= 0) {
+	if (_n == 0) {
+		printf("usage: gen_random [-b] [-Du|s|r|n|f|z|o] [-k N] [-s seed] [-j N] 1000000\n");
+		return 1;
+	}
+	if (_n < 0) {
 		printf("array length must be a positive number.");
 		return 1;
 	}
 
-	// init random generator
-	srand(time(NULL));
+	if (_nthreads <= 0) {
+		_nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if (_nthreads <= 0)
+			_nthreads = 1;
+	}
+	if (_k == 0) {
+		_k = _dist == 'n' ? _n / SWAPS_DIV : _dist == 'f' ? FEW_UNIQUE : ZIPF_RANKS;
+	}
+	if (_dist == 'n')
+		_swaps_build();
+
+	// two sets of blocks, the threads generate one while the other is written
+	for (cur = 0; cur < 2; cur++) {
+		blocks[cur] = (struct _block *)malloc(_nthreads * sizeof(struct _block));
+		for (t = 0; t < _nthreads; t++) {
+			blocks[cur][t].nums = (int *)malloc(BLOCK_LEN * sizeof(int));
+			blocks[cur][t].text = _binary ? NULL : (char *)malloc(BLOCK_LEN * WR_MAX_TOKEN);
+		}
+	}
+	threads = (pthread_t *)malloc(_nthreads * sizeof(pthread_t));
+
+	if (_binary)
+		_writebin_hdr(_n);
+
+	cur = 0;
+	prev = 0;
+	for (p = 0; ; cur ^= 1) {
+		// generate the next set
+		for (t = 0; t < _nthreads && p < _n; t++, p += BLOCK_LEN) {
+			blocks[cur][t].p = p;
+			blocks[cur][t].r = p + BLOCK_LEN < _n ? p + BLOCK_LEN : _n;
+			pthread_create(&threads[t], NULL, _gen_run, (void *)&blocks[cur][t]);
+		}
+
+		// write the previous one meanwhile
+		for (i = 0; i < prev; i++) {
+			if (_binary) {
+				_writeraws(blocks[cur ^ 1][i].nums, blocks[cur ^ 1][i].r - blocks[cur ^ 1][i].p);
+			} else {
+				_writebuf(blocks[cur ^ 1][i].text, blocks[cur ^ 1][i].len);
+			}
+		}
 
-	while (num-- > 0) {
-		printf("%i\n", rand());
+		for (i = 0; i < t; i++) {
+			pthread_join(threads[i], NULL);
+		}
+		if (t == 0)
+			break;
+		prev = t;
 	}
+	_wr_flush();
 
 	return 0;
-}
\ No newline at end of file
+}
+
+/* splitmix64 of the seed and the counter i */
+static inline uint64_t _hash(uint64_t seed, uint64_t i) {
+	uint64_t z = seed * GOLDEN + (i + 1) * 0xbf58476d1ce4e5b9ull;
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+/* the i-th number of an evenly spread sorted array */
+static inline int _sorted_num(long i) {
+	return (int)((unsigned __int128)i * VALUE_RANGE / _n);
+}
+
+/* applies _k random swaps to the positions they touch, so that a number of
+   the nearly sorted array is the sorted number of _swap_src at its position */
+void _swaps_build() {
+	long i, m, a, b, t, *pa, *pb;
+
+	_swap_pos = (long *)malloc(2 * _k * sizeof(long));
+	for (i = 0; i < 2 * _k; i++) {
+		_swap_pos[i] = (long)(_hash(_seed ^ GOLDEN, i) % (uint64_t)_n);
+	}
+	qsort(_swap_pos, 2 * _k, sizeof(long), _cmp_long);
+	for (i = 0, m = 0; i < 2 * _k; i++) {
+		if (m == 0 || _swap_pos[i] != _swap_pos[m - 1])
+			_swap_pos[m++] = _swap_pos[i];
+	}
+	_nswap = m;
+
+	_swap_src = (long *)malloc(m * sizeof(long));
+	for (i = 0; i < m; i++) {
+		_swap_src[i] = _swap_pos[i];
+	}
+	for (i = 0; i < _k; i++) {
+		a = (long)(_hash(_seed ^ GOLDEN, 2 * i) % (uint64_t)_n);
+		b = (long)(_hash(_seed ^ GOLDEN, 2 * i + 1) % (uint64_t)_n);
+		pa = (long *)bsearch(&a, _swap_pos, m, sizeof(long), _cmp_long);
+		pb = (long *)bsearch(&b, _swap_pos, m, sizeof(long), _cmp_long);
+		t = _swap_src[pa - _swap_pos];
+		_swap_src[pa - _swap_pos] = _swap_src[pb - _swap_pos];
+		_swap_src[pb - _swap_pos] = t;
+	}
+}
+
+int _cmp_long(const void *a, const void *b) {
+	long x = *(const long *)a, y = *(const long *)b;
+	return x < y ? -1 : x > y;
+}
+
+void *_gen_run(void *arg) {
+	struct _block *b = (struct _block *)arg;
+	double lnk = log((double)_k + 1);
+	long i, j, k, m = b->r - b->p, s = 0;
+	int *a = b->nums;
+	char *e;
+
+	switch (_dist) {
+		case 'u':
+			for (i = 0; i < m; i++)
+				a[i] = (int)(_hash(_seed, b->p + i) % VALUE_RANGE);
+			break;
+		case 's':
+			for (i = 0; i < m; i++)
+				a[i] = _sorted_num(b->p + i);
+			break;
+		case 'r':
+			for (i = 0; i < m; i++)
+				a[i] = _sorted_num(_n - 1 - (b->p + i));
+			break;
+		case 'n':
+			// the first swapped position of the block, then they are walked along
+			for (j = 0, k = _nswap; j < k; ) {
+				if (_swap_pos[(j + k) / 2] < b->p)
+					j = (j + k) / 2 + 1;
+				else
+					k = (j + k) / 2;
+			}
+			for (i = 0; i < m; i++) {
+				s = b->p + i;
+				if (j < _nswap && _swap_pos[j] == s)
+					s = _swap_src[j++];
+				a[i] = _sorted_num(s);
+			}
+			break;
+		case 'f':
+			// the distinct values are spread over the range
+			for (i = 0; i < m; i++)
+				a[i] = (int)(_hash(~_seed, _hash(_seed, b->p + i) % _k) % VALUE_RANGE);
+			break;
+		case 'z':
+			// inverse of the continuous cdf of the density 1/x on [1, k + 1)
+			for (i = 0; i < m; i++) {
+				s = (long)exp((double)(_hash(_seed, b->p + i) >> 11) * 0x1.0p-53 * lnk) - 1;
+				a[i] = (int)(s < _k ? s : _k - 1);
+			}
+			break;
+		case 'o':
+			for (i = 0; i < m; i++) {
+				s = b->p + i;
+				a[i] = _sorted_num(s < (_n + 1) / 2 ? 2 * s : 2 * (_n - 1 - s) + 1);
+			}
+			break;
+	}
+
+	if (b->text != NULL) {
+		e = b->text;
+		for (i = 0; i < m; i++)
+			e = _fmtnum(e, a[i]);
+		b->len = e - b->text;
+	}
+	return NULL;
+}
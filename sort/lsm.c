@@ -0,0 +1,431 @@
+/* Incremental sorted store of a stream of ints from stdin, text or binary, with rank
+   and range queries at any moment (LSM-style).
+   Appended numbers go to a buffer, a full buffer is sorted and frozen into an immutable
+   sorted run. Runs are tiered: a background thread merges every fanout runs of a level
+   into a run of the next level. A query searches the buffer and all the runs.
+   Usage: gen_random -b 10000000 | lsm
+   		-b N numbers in the buffer (LSM_BUF_LEN by default);
+   		-f N runs merged at a time (LSM_FANOUT by default);
+   		-q N appends between queries (100 by default), 0 for no queries; the queries
+   			alternate between the rank of a random key (the count of smaller numbers)
+   			and the count of numbers in a random range [lo, hi);
+   		-c to check the ranks and the range counts against a sorted copy of the input
+   			at the end.
+   It prints the append throughput, the query latency, the runs of every level and
+   the write amplification (numbers written into runs per number appended).
+   Build with -pthread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "numio.h"
+#include "sort_kernels.h"
+#include "tuning.h"
+
+#define LSM_BUF_LEN		8192
+#define LSM_FANOUT		4
+#define LSM_MAX_RUNS	256
+#define LSM_MAX_L0		16 // level 0 runs before the appends wait for the compaction
+#define QUERY_EVERY		100
+#define RANGE_WIDTH		(1 << 20) // max width of a range query
+#define CHECK_KEYS		10000
+
+SORT_KERNELS(int, i32, uint32_t, _key_i32)
+
+/* an immutable sorted run */
+struct _run {
+	int *a;
+	long n;
+	int level;
+	int busy;		// being merged by the compaction
+};
+
+/* the store */
+void _append(int);
+void _freeze();
+long _rank(int);
+long _range(int, int);
+long _lower(int*, long, int);
+
+/* compaction */
+void *_compact_run(void*);
+int _compact_level();
+struct _run *_compact(struct _run**, int);
+
+struct _run *_runs[LSM_MAX_RUNS];
+int _nruns = 0;
+int *_buf;
+int _nbuf = 0;
+int _buf_len = LSM_BUF_LEN;
+int _fanout = LSM_FANOUT;
+int _stopping = 0;
+pthread_mutex_t _lsm_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t _lsm_cond = PTHREAD_COND_INITIALIZER;
+
+// numbers appended, written by the freezes and by the compactions
+long _appended = 0, _flushed = 0, _compacted = 0;
+long _compactions = 0;
+double _stall_ns = 0;
+
+static inline uint64_t _hash(uint64_t);
+
+int main(int argc, char const *argv[])
+{
+	pthread_t compactor;
+	double *lat;
+	double t0, t1, total, qtotal, med, lo, hi;
+	long every = QUERY_EVERY, nq = 0, qcap = 1 << 16, nall = 0, acap = 0, r1, r2, bad;
+	int *all = NULL;
+	int check = 0, levels[64], num, key, end, i, l;
+
+	while (--argc > 0) {
+		++argv;
+		if (*(*argv)++ != '-')
+			continue;
+		switch (**argv) {
+			case 'b':
+				// either -b8192 or -b 8192
+				if (*++(*argv) == '\0' && argc > 1) {
+					--argc;
+					++argv;
+				}
+				_buf_len = atoi(*argv);
+				if (_buf_len <= 0) {
+					printf("buffer size must be a positive number.\n");
+					return 1;
+				}
+				break;
+			case 'f':
+				if (*++(*argv) == '\0' && argc > 1) {
+					--argc;
+					++argv;
+				}
+				_fanout = atoi(*argv);
+				if (_fanout < 2 || _fanout > LSM_MAX_L0) {
+					printf("fanout must be 2 to %d.\n", LSM_MAX_L0);
+					return 1;
+				}
+				break;
+			case 'q':
+				if (*++(*argv) == '\0' && argc > 1) {
+					--argc;
+					++argv;
+				}
+				every = atol(*argv);
+				if (every < 0) {
+					printf("appends between queries must be a positive number or 0.\n");
+					return 1;
+				}
+				break;
+			case 'c':
+				check = 1;
+				break;
+			default:
+				printf("unknown option %s\n", *argv);
+				return 1;
+		}
+	}
+
+	_buf = (int *)malloc(_buf_len * sizeof(int));
+	lat = (double *)malloc(qcap * sizeof(double));
+	pthread_create(&compactor, NULL, _compact_run, NULL);
+
+	// the mixed load: appends from the input, a query every `every` appends
+	qtotal = 0;
+	t0 = _now_ns();
+	while (_readnum(&num)) {
+		_append(num);
+		if (check) {
+			if (nall == acap) {
+				acap = acap > 0 ? 2 * acap : 1 << 20;
+				all = (int *)realloc(all, acap * sizeof(int));
+			}
+			all[nall++] = num;
+		}
+
+		if (every > 0 && _appended % every == 0) {
+			key = (int)_hash(nq);
+			t1 = _now_ns();
+			if (nq % 2 == 0) {
+				_rank(key);
+			} else {
+				key = key > INT32_MAX - RANGE_WIDTH ? INT32_MAX - RANGE_WIDTH : key;
+				_range(key, key + (int)(_hash(~nq) % RANGE_WIDTH));
+			}
+			t1 = _now_ns() - t1;
+			qtotal += t1;
+			if (nq == qcap) {
+				qcap *= 2;
+				lat = (double *)realloc(lat, qcap * sizeof(double));
+			}
+			lat[nq++] = t1;
+		}
+	}
+	total = _now_ns() - t0;
+
+	// let the compaction finish the pending merges
+	pthread_mutex_lock(&_lsm_lock);
+	_stopping = 1;
+	pthread_cond_broadcast(&_lsm_cond);
+	pthread_mutex_unlock(&_lsm_lock);
+	pthread_join(compactor, NULL);
+
+	printf("appended %ld numbers in %.1fms, %.2f M/s without the queries, %.1fms stalled\n",
+		_appended, total / 1e6, _appended / ((total - qtotal > 0 ? total - qtotal : 1) / 1e3), _stall_ns / 1e6);
+	if (nq > 0) {
+		med = _median_ci(lat, (int)nq, &lo, &hi);
+		printf("%ld queries, latency median %.2fus, p99 %.2fus, max %.2fus\n", nq, med / 1e3,
+			lat[nq * 99 / 100] / 1e3, lat[nq - 1] / 1e3);
+	}
+
+	memset((void *)levels, 0, sizeof(levels));
+	for (i = 0; i < _nruns; i++)
+		levels[_runs[i]->level]++;
+	printf("%d numbers in the buffer, %d runs:", _nbuf, _nruns);
+	for (l = 0; l < 64; l++) {
+		if (levels[l] > 0)
+			printf(" %d at level %d", levels[l], l);
+	}
+	printf("\n%ld compactions, write amplification %.2f (%ld frozen, %ld merged)\n",
+		_compactions, (double)(_flushed + _compacted) / (_appended > 0 ? _appended : 1),
+		_flushed, _compacted);
+
+	if (check) {
+		_sort_radix_i32(all, nall);
+		bad = 0;
+		for (i = 0; i < CHECK_KEYS; i++) {
+			// numbers of the input, and any numbers, all of them when there is no input
+			key = i % 2 || nall == 0 ? (int)_hash(i) : all[_hash(i) % nall];
+			r1 = _rank(key);
+			r2 = _lower(all, nall, key);
+			bad += r1 != r2;
+
+			// a range from the key, of any width up to the end of the ints
+			end = (int)(key + (int64_t)(_hash(~i) % ((int64_t)INT32_MAX - key + 1)));
+			r1 = _range(key, end);
+			r2 = _lower(all, nall, end) - _lower(all, nall, key);
+			bad += r1 != r2;
+		}
+		if (bad > 0) {
+			printf("%ld of %d ranks and ranges are wrong.\n", bad, 2 * CHECK_KEYS);
+			return 1;
+		}
+		printf("%d ranks and %d ranges have been successfully checked.\n", CHECK_KEYS, CHECK_KEYS);
+	}
+
+	return 0;
+}
+
+void _append(int num) {
+	_buf[_nbuf++] = num;
+	_appended++;
+	if (_nbuf == _buf_len)
+		_freeze();
+}
+
+/* sorts the buffer into a level 0 run, waits while level 0 is full */
+void _freeze() {
+	struct _run *r;
+	double t;
+	int i, l0;
+
+	r = (struct _run *)malloc(sizeof(struct _run));
+	r->a = _buf;
+	r->n = _nbuf;
+	r->level = 0;
+	r->busy = 0;
+	_sort_radix_i32(r->a, r->n);
+	_flushed += _nbuf;
+
+	pthread_mutex_lock(&_lsm_lock);
+	for (t = _now_ns(); ; ) {
+		for (i = 0, l0 = 0; i < _nruns; i++)
+			l0 += _runs[i]->level == 0;
+		if (l0 < LSM_MAX_L0 && _nruns < LSM_MAX_RUNS)
+			break;
+		pthread_cond_wait(&_lsm_cond, &_lsm_lock);
+	}
+	_stall_ns += _now_ns() - t;
+	_runs[_nruns++] = r;
+	pthread_cond_broadcast(&_lsm_cond);
+	pthread_mutex_unlock(&_lsm_lock);
+
+	_buf = (int *)malloc(_buf_len * sizeof(int));
+	_nbuf = 0;
+}
+
+/* the count of numbers less than key, in the buffer and the runs */
+long _rank(int key) {
+	long c = 0;
+	int i;
+
+	for (i = 0; i < _nbuf; i++)
+		c += _buf[i] < key;
+
+	// the runs are freed by the compaction only after they are out of the list
+	pthread_mutex_lock(&_lsm_lock);
+	for (i = 0; i < _nruns; i++)
+		c += _lower(_runs[i]->a, _runs[i]->n, key);
+	pthread_mutex_unlock(&_lsm_lock);
+
+	return c;
+}
+
+/* the count of the numbers in [lo, hi), the buffer counted without branches,
+   both ends of every run searched under the same lock */
+long _range(int lo, int hi) {
+	long c = 0;
+	int i;
+
+	if (hi <= lo)
+		return 0;
+	for (i = 0; i < _nbuf; i++)
+		c += (uint32_t)_buf[i] - (uint32_t)lo < (uint32_t)hi - (uint32_t)lo;
+
+	pthread_mutex_lock(&_lsm_lock);
+	for (i = 0; i < _nruns; i++)
+		c += _lower(_runs[i]->a, _runs[i]->n, hi) - _lower(_runs[i]->a, _runs[i]->n, lo);
+	pthread_mutex_unlock(&_lsm_lock);
+
+	return c;
+}
+
+/* the position of the first number >= key in a[0..n), without branches */
+long _lower(int *a, long n, int key) {
+	long half;
+	int *b = a;
+
+	if (n == 0)
+		return 0;
+	while (n > 1) {
+		half = n / 2;
+		b = b[half - 1] < key ? b + half : b;
+		n -= half;
+	}
+	return (b - a) + (*b < key);
+}
+
+/* the background compaction, merges the oldest _fanout runs of the lowest
+   full level, until _stopping and no level is full */
+void *_compact_run(void *arg) {
+	struct _run *in[LSM_MAX_L0], *out;
+	int l, i, j, k;
+
+	(void)arg;
+	pthread_mutex_lock(&_lsm_lock);
+	for (;;) {
+		l = _compact_level();
+		if (l < 0) {
+			if (_stopping)
+				break;
+			pthread_cond_wait(&_lsm_cond, &_lsm_lock);
+			continue;
+		}
+
+		// the runs are appended in order, so the first ones of a level are the oldest
+		for (i = 0, k = 0; i < _nruns && k < _fanout; i++) {
+			if (_runs[i]->level == l && !_runs[i]->busy) {
+				_runs[i]->busy = 1;
+				in[k++] = _runs[i];
+			}
+		}
+		pthread_mutex_unlock(&_lsm_lock);
+
+		out = _compact(in, k);
+
+		// the merged run takes the place of the first input, keeping the order
+		pthread_mutex_lock(&_lsm_lock);
+		for (i = 0, j = 0; i < _nruns; i++) {
+			if (_runs[i] == in[0])
+				_runs[j++] = out;
+			else if (!_runs[i]->busy || _runs[i]->level != l)
+				_runs[j++] = _runs[i];
+		}
+		_nruns = j;
+		_compacted += out->n;
+		_compactions++;
+		pthread_cond_broadcast(&_lsm_cond);
+		pthread_mutex_unlock(&_lsm_lock);
+
+		for (i = 0; i < k; i++) {
+			free((void *)in[i]->a);
+			free((void *)in[i]);
+		}
+		pthread_mutex_lock(&_lsm_lock);
+	}
+	pthread_mutex_unlock(&_lsm_lock);
+	return NULL;
+}
+
+/* the lowest level with _fanout runs to merge, or -1 */
+int _compact_level() {
+	int cnt[64];
+	int i;
+
+	memset((void *)cnt, 0, sizeof(cnt));
+	for (i = 0; i < _nruns; i++) {
+		if (!_runs[i]->busy && ++cnt[_runs[i]->level] == _fanout)
+			return _runs[i]->level;
+	}
+	return -1;
+}
+
+/* merges the k runs into a run of the next level: they are copied side by side,
+   then adjacent pairs are merged pass by pass with _merge_i32 */
+struct _run *_compact(struct _run **in, int k) {
+	struct _run *out;
+	long b[LSM_MAX_L0 + 1];
+	long n, p;
+	int *src, *dst, *t;
+	int i, m;
+
+	for (i = 0, n = 0; i < k; i++)
+		n += in[i]->n;
+	src = (int *)malloc(n * sizeof(int));
+	dst = (int *)malloc(n * sizeof(int));
+	b[0] = 0;
+	for (i = 0; i < k; i++) {
+		memcpy((void *)(src + b[i]), (void *)in[i]->a, in[i]->n * sizeof(int));
+		b[i + 1] = b[i] + in[i]->n;
+	}
+
+	for (m = k; m > 1; m = (m + 1) / 2) {
+		for (i = 0; i + 1 < m; i += 2) {
+			if (b[i + 1] < b[i + 2] && b[i] < b[i + 1])
+				_merge_i32(src, dst, b[i], b[i + 1], b[i + 2]);
+			else
+				memcpy((void *)(dst + b[i]), (void *)(src + b[i]), (b[i + 2] - b[i]) * sizeof(int));
+		}
+		if (m % 2) {
+			p = b[m - 1];
+			memcpy((void *)(dst + p), (void *)(src + p), (b[m] - p) * sizeof(int));
+		}
+		// the boundaries of the merged pairs
+		for (i = 0; i <= (m + 1) / 2; i++)
+			b[i] = b[2 * i < m ? 2 * i : m];
+		t = src;
+		src = dst;
+		dst = t;
+	}
+	free((void *)dst);
+
+	out = (struct _run *)malloc(sizeof(struct _run));
+	out->a = src;
+	out->n = n;
+	out->level = in[0]->level + 1;
+	out->busy = 0;
+	return out;
+}
+
+/* splitmix64 of the counter i */
+static inline uint64_t _hash(uint64_t i) {
+	uint64_t z = (i + 1) * 0x9e3779b97f4a7c15ull;
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
@@ -1,75 +1,166 @@
-/* Find a maximum k constant, where sort_insert(k) faster than sort_merge(k) */
+/* Tunes the threshold of sort_merge: the size k of the sub-arrays sorted with the base
+   case of -Oi (the AVX2 sorting network up to NET_SORT_LEN, the insertion sort above)
+   instead of being split and merged.
+   Every sample times the -Oi merge sort with the threshold k of BATCH_LEN fresh arrays
+   of SORT_LEN numbers with clock_gettime, for random, sorted, reversed and few-unique
+   arrays, after a warmup. The samples of k are summarized by the median and its 95%
+   confidence interval, the k with the lowest median is the threshold.
+   Options: -r N samples per k (TRIALS by default), -k N the max k (MAX_K);
+   		-n to only print it, without writing insert_sort_len to the tuning file (tuning.h).
+ */
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/time.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
 
-#define MAX_BUF_LEN 	12
-#define MAX_ARR_LEN 	1000
-#define INF				(1u << 31) - 1
+#include "sort_net.h"
+#include "tuning.h"
+
+#define MAX_K			128
+#define SORT_LEN		5000 // not a power of 2, so that every k gives other sub-arrays
+#define BATCH_LEN		4 // arrays of a distribution sorted in a sample
+#define TRIALS			21
+#define WARMUP			3
+#define DISTS			4
 
-int _getnum();
 void _sort_insert(int *arr, int n);
 
-/* merge sort, optimized with sentinels */
-void _sort_merge_s(int*, int, int);
+/* sorting network */
+void _sort_net(int *arr, int n);
+
+int _avx2 = 0;
+
+/* merge sort with the base case for k numbers or less, as -Oi of sort_merge */
+void _sort_merge_i(int*, int, int, int);
 void _merge_s(int*, int, int, int);
 
+/* measurement */
+void _gen(int*, int, uint64_t*);
+double _sample(int*, int*, int);
+
 int main(int argc, char const *argv[])
 {
-	int arr[MAX_ARR_LEN];
-	int i = 0;
-	int num;
-
-	// read an array from stdin
-	while ((num = _getnum()) != EOF && i < MAX_ARR_LEN) {
-		arr[i++] = num;
+	int maxk = MAX_K, trials = TRIALS, write = 1;
+	int *src, *tmp;
+	double *t;
+	double m, lo, hi, bm, blo, bhi;
+	uint64_t seed = 1;
+	int k, r, d, best;
+
+	while (--argc > 0) {
+		++argv;
+		if (*(*argv)++ != '-')
+			continue;
+		switch (**argv) {
+			case 'r':
+				// either -r21 or -r 21
+				if (*++(*argv) == '\0' && argc > 1) {
+					--argc;
+					++argv;
+				}
+				trials = atoi(*argv);
+				break;
+			case 'k':
+				if (*++(*argv) == '\0' && argc > 1) {
+					--argc;
+					++argv;
+				}
+				maxk = atoi(*argv);
+				break;
+			case 'n':
+				write = 0;
+				break;
+			default:
+				printf("unknown option %s\n", *argv);
+				return 1;
+		}
+	}
+	if (trials < 1 || maxk < 2) {
+		printf("samples and max k must be positive numbers.\n");
+		return 1;
 	}
 
-	// measure sorting times
-	int tmp[MAX_ARR_LEN];
-	int j, k;
-	struct timeval t1, t2;
-	double elapsed1, elapsed2;
-	int c = 0;
-
-	printf("n\tinsert, ms\tmerge, ms\n");
-	for (k = 1; k <= i; k++) {
-		// insert sort
-		for (j = 0; j < k; j++) {
-			tmp[j] = arr[j];
+	_avx2 = __builtin_cpu_supports("avx2");
+
+	// the same arrays for every k
+	src = (int *)malloc((long)DISTS * BATCH_LEN * SORT_LEN * sizeof(int));
+	tmp = (int *)malloc((long)BATCH_LEN * SORT_LEN * sizeof(int));
+	t = (double *)malloc(trials * sizeof(double));
+	for (d = 0; d < DISTS; d++)
+		_gen(src + (long)d * BATCH_LEN * SORT_LEN, d, &seed);
+
+	printf("k\tns per number\t95%% ci\n");
+	best = 0;
+	bm = blo = bhi = 0;
+	for (k = 2; k <= maxk; k++) {
+		for (r = -WARMUP; r < trials; r++) {
+			m = 0;
+			for (d = 0; d < DISTS; d++)
+				m += _sample(src + (long)d * BATCH_LEN * SORT_LEN, tmp, k);
+			if (r >= 0)
+				t[r] = m / ((double)DISTS * BATCH_LEN * SORT_LEN);
 		}
-		gettimeofday(&t1, NULL);
-		_sort_insert(tmp, k);
-		gettimeofday(&t2, NULL);
-		elapsed1 = (t2.tv_sec - t1.tv_sec) * 1000.0;     // sec to ms
-    	elapsed1 += (t2.tv_usec - t1.tv_usec) / 1000.0;  // us to ms
-
-    	// merge sort
-    	for (j = 0; j < k; j++) {
-			tmp[j] = arr[j];
+		m = _median_ci(t, trials, &lo, &hi);
+		printf("%d\t%.3f\t\t%.3f-%.3f\n", k, m, lo, hi);
+
+		if (best == 0 || m < bm) {
+			best = k;
+			bm = m;
+			blo = lo;
+			bhi = hi;
 		}
-		gettimeofday(&t1, NULL);
-		_sort_merge_s(tmp, 0, k - 1);
-		gettimeofday(&t2, NULL);
-		elapsed2 = (t2.tv_sec - t1.tv_sec) * 1000.0;     // sec to ms
-    	elapsed2 += (t2.tv_usec - t1.tv_usec) / 1000.0;  // us to ms
-
-    	printf("%i\t%f\t%f\n", k, elapsed1, elapsed2);
-    	
-    	if ((elapsed1 - elapsed2) >= 0.001) {
-    		c++;
-    	} else {
-    		c = 0;
-    	}
-    	if (c > 10) {
-    		break;
-    	}
+	}
+
+	printf("insert_sort_len %d (%.3f ns per number, 95%% ci %.3f-%.3f)\n", best, bm, blo, bhi);
+	if (write) {
+		if (_tuning_set("insert_sort_len", best) != 0)
+			return 1;
+		printf("written to %s\n", _tuning_path());
 	}
 
 	return 0;
 }
 
+/* BATCH_LEN arrays of SORT_LEN numbers of the distribution d: random, sorted,
+   reversed or few-unique */
+void _gen(int *a, int d, uint64_t *seed) {
+	int i, j, t, *b;
+
+	for (j = 0; j < BATCH_LEN; j++) {
+		b = a + (long)j * SORT_LEN;
+		for (i = 0; i < SORT_LEN; i++) {
+			// xorshift64
+			*seed ^= *seed << 13;
+			*seed ^= *seed >> 7;
+			*seed ^= *seed << 17;
+			b[i] = (int)(*seed % 1000000000);
+			if (d == 3)
+				b[i] %= 4;
+		}
+		if (d == 1 || d == 2)
+			_sort_merge_i(b, 0, SORT_LEN - 1, NET_SORT_LEN);
+		for (i = 0; d == 2 && i < SORT_LEN / 2; i++) {
+			t = b[i];
+			b[i] = b[SORT_LEN - 1 - i];
+			b[SORT_LEN - 1 - i] = t;
+		}
+	}
+}
+
+/* ns to sort the BATCH_LEN arrays of src copied to tmp with the threshold k */
+double _sample(int *src, int *tmp, int k) {
+	double t;
+	int j;
+
+	memcpy((void *)tmp, (void *)src, (long)BATCH_LEN * SORT_LEN * sizeof(int));
+	t = _now_ns();
+	for (j = 0; j < BATCH_LEN; j++)
+		_sort_merge_i(tmp + (long)j * SORT_LEN, 0, SORT_LEN - 1, k);
+	return _now_ns() - t;
+}
+
 void _sort_insert(int *arr, int n) {
 	int i, j, k;
 	for (i = 1; i < n; i++) {
@@ -81,12 +172,18 @@ void _sort_insert(int *arr, int n) {
 	}
 }
 
-void _sort_merge_s(int *a, int p, int r) {
+void _sort_merge_i(int *a, int p, int r, int k) {
 	if (p >= r)
 		return;
+
+	if (r - p + 1 <= k) {
+		_sort_net(a + p, r - p + 1);
+		return;
+	}
+
 	int q = (p + r) / 2; // greatest int <= q
-	_sort_merge_s(a, p, q);
-	_sort_merge_s(a, q + 1, r);
+	_sort_merge_i(a, p, q, k);
+	_sort_merge_i(a, q + 1, r, k);
 	_merge_s(a, p, q, r);
 }
 
@@ -97,8 +194,8 @@ void _merge_s(int *a, int p, int q, int r) {
 	// copy left and right parts of the array
 	n1 = q - p + 1;
 	n2 = r - q;
-	la = (int *)malloc((n1 + 1) * sizeof(int));
-	ra = (int *)malloc((n2 + 1) * sizeof(int));
+	la = (int *)malloc(n1 * sizeof(int));
+	ra = (int *)malloc(n2 * sizeof(int));
 	k = p;
 	for (i = 0; i < n1; i++) {
 		la[i] = a[k++];
@@ -107,18 +204,32 @@ void _merge_s(int *a, int p, int q, int r) {
 		ra[j] = a[k++];
 	}
 
-	// add sentinel elements to the end
-	la[n1] = INF;
-	ra[n2] = INF;
-
-	// merge
+	// the part with the smaller last number runs out first, the last number of
+	// the other part stops the merge as a sentinel would (an INF sentinel is
+	// wrong for inputs with INT_MAX), then the rest of the other part is copied
 	k = p;
 	i = 0;
 	j = 0;
-	while (k <= r) {
-		if (la[i] < ra[j]) {
+	if (a[r] <= a[q]) {
+		while (j < n2) {
+			if (la[i] < ra[j]) {
+				a[k++] = la[i++];
+			} else {
+				a[k++] = ra[j++];
+			}
+		}
+		while (i < n1) {
 			a[k++] = la[i++];
-		} else {
+		}
+	} else {
+		while (i < n1) {
+			if (la[i] < ra[j]) {
+				a[k++] = la[i++];
+			} else {
+				a[k++] = ra[j++];
+			}
+		}
+		while (j < n2) {
 			a[k++] = ra[j++];
 		}
 	}
@@ -127,26 +238,12 @@ void _merge_s(int *a, int p, int q, int r) {
 	free((void *)ra);
 }
 
-char _buf[MAX_BUF_LEN];
-int _getnum() {
-	int c;
-	char *ptr = _buf;
-
-	// skip spaces until we get a start of a new number
-	for (c = getchar(); c == '\n' || c == ' '; c = getchar());
-
-	// read chars of a number
-	while (c != EOF && c != '\n' && c != ' ' 
-		&& ptr < _buf + MAX_BUF_LEN - 1) {
-		*ptr++ = c;
-		c = getchar();
-	}
-
-	*ptr = '\0';
-
-	if (ptr == _buf && c == EOF) {
-		return EOF;
+/* sorts up to NET_SORT_LEN numbers with a sorting network,
+   falls back to the insertion sort without AVX2 */
+void _sort_net(int *arr, int n) {
+	if (!_avx2 || n < 2 || n > NET_SORT_LEN) {
+		_sort_insert(arr, n);
+		return;
 	}
-
-	return atoi(_buf);
-}
\ No newline at end of file
+	_sort_net_pad(arr, n);
+}
@@ -0,0 +1,528 @@
+/* Fast integer input and output shared by the sort tools.
+   stdin is mmapped when it is a regular file and read with large read() calls
+   otherwise (pipes), decimal numbers are converted 8 digits at a time (SWAR).
+   Numbers are separated by anything that is not a digit or a minus sign.
+   Output goes to a large buffer, two digits at a time, flushed with write().
+   Both also handle the binary format: a header with the magic, the element type
+   and the count, followed by raw little-endian values. Binary input is detected
+   by its magic, and a mmapped binary file can be used in place with _readbin.
+   The int readers take BIN_INT32 only. A tool that sets _rd_typed also takes
+   uint32, int64, float and double arrays with _readall_typed, text or binary,
+   and writes them with _writetyped or _writebin_typed_hdr.
+ */
+
+#ifndef NUMIO_H
+#define NUMIO_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define RD_BUF_LEN		(1 << 20)
+#define RD_MAX_TOKEN	64 // the buffer is refilled before fewer bytes are left
+#define WR_BUF_LEN		(1 << 20)
+#define WR_MAX_TOKEN	12 // sign, 10 digits and a new line
+#define BIN_MAGIC		"CALG"
+#define BIN_INT32		1
+#define BIN_UINT32		2
+#define BIN_INT64		3
+#define BIN_FLOAT32		4
+#define BIN_FLOAT64		5
+#define WR_MAX_TYPED	32 // a typed number in text and a new line
+#define RD_TYPED_LEN	(1 << 16) // first size of a typed array read from a stream
+
+struct _binhdr {
+	char magic[4];		// BIN_MAGIC
+	uint32_t type;		// BIN_INT32
+	uint64_t count;
+};
+
+static const char *_rd_ptr, *_rd_end, *_rd_base;
+static char *_rd_buf;
+static int _rd_fd = 0;		// stdin unless switched with _rd_reset
+static int _rd_mode = 0;	// 0 before the first read, 'm' for mmap, 'r' for read()
+static int _rd_eof = 0;
+static long _rd_bytes = 0;	// bytes consumed before the current buffer
+static int _rd_bin = 0;		// binary input
+static long _rd_left = 0;	// numbers left in a binary input
+static uint32_t _rd_type = BIN_INT32;	// element type of a binary input
+static int _rd_typed = 0;	// the tool takes binary inputs of any element type
+
+static const uint64_t _rd_pow10[9] = {
+	1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000
+};
+
+static void _rd_fill();
+
+/* skips the header of a binary input */
+static void _rd_header() {
+	struct _binhdr h;
+
+	if (_rd_end - _rd_ptr < (long)sizeof(h) || memcmp((void *)_rd_ptr, BIN_MAGIC, 4) != 0)
+		return;
+
+	memcpy((void *)&h, (void *)_rd_ptr, sizeof(h));
+	if (h.type != BIN_INT32 && !(_rd_typed && h.type >= BIN_UINT32 && h.type <= BIN_FLOAT64)) {
+		fprintf(stderr, "unsupported element type %u\n", h.type);
+		exit(1);
+	}
+	_rd_bin = 1;
+	_rd_type = h.type;
+	_rd_left = (long)h.count;
+	_rd_ptr += sizeof(h);
+}
+
+static void _rd_open() {
+	struct stat st;
+	void *p;
+
+	if (fstat(_rd_fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		// private writable pages, so that a binary array can be sorted in place
+		p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, _rd_fd, 0);
+		if (p != MAP_FAILED) {
+			madvise(p, st.st_size, MADV_SEQUENTIAL);
+			_rd_mode = 'm';
+			_rd_base = _rd_ptr = (const char *)p;
+			_rd_end = _rd_ptr + st.st_size;
+			_rd_eof = 1;
+			_rd_header();
+			return;
+		}
+	}
+
+	_rd_mode = 'r';
+	_rd_buf = (char *)malloc(RD_BUF_LEN);
+	_rd_base = _rd_ptr = _rd_end = _rd_buf;
+	_rd_fill();
+	_rd_header();
+}
+
+/* moves the unread tail to the beginning of the buffer and reads up to its end */
+static void _rd_fill() {
+	long left, n;
+
+	left = _rd_end - _rd_ptr;
+	_rd_bytes += _rd_ptr - _rd_base;
+	memmove((void *)_rd_buf, (void *)_rd_ptr, left);
+	_rd_ptr = _rd_base = _rd_buf;
+	_rd_end = _rd_buf + left;
+
+	while (!_rd_eof && _rd_end < _rd_buf + RD_BUF_LEN) {
+		n = read(_rd_fd, (void *)_rd_end, _rd_buf + RD_BUF_LEN - _rd_end);
+		if (n <= 0) {
+			_rd_eof = 1;
+			break;
+		}
+		_rd_end += n;
+	}
+}
+
+/* converts the leading digits of the 8 bytes at x (already minus '0'),
+   len of them, 1 <= len <= 8 */
+static inline uint64_t _rd_swar8(uint64_t x, int len) {
+	// right-align the digits, the bytes shifted in are leading zeros
+	x <<= 8 * (8 - len);
+	x = x * 10 + (x >> 8);
+	x = (((x & 0x000000FF000000FFull) * (100 + (1000000ull << 32)))
+		+ (((x >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+	return x;
+}
+
+/* reads the next number, returns 0 at the end of the input */
+static inline int _readnum(int *num) {
+	const char *p;
+	uint64_t v, x, t, m;
+	int neg, len;
+
+	if (_rd_mode == 0)
+		_rd_open();
+
+	if (_rd_bin) {
+		if (_rd_end - _rd_ptr < RD_MAX_TOKEN && !_rd_eof)
+			_rd_fill();
+		if (_rd_left == 0 || _rd_end - _rd_ptr < 4)
+			return 0;
+		memcpy((void *)num, (void *)_rd_ptr, 4);
+		_rd_ptr += 4;
+		_rd_left--;
+		return 1;
+	}
+
+	// skip separators
+	for (;;) {
+		if (_rd_end - _rd_ptr < RD_MAX_TOKEN && !_rd_eof)
+			_rd_fill();
+		while (_rd_ptr < _rd_end && (unsigned)(*_rd_ptr - '0') > 9 && *_rd_ptr != '-')
+			_rd_ptr++;
+		if (_rd_ptr < _rd_end)
+			break;
+		if (_rd_eof)
+			return 0;
+	}
+
+	p = _rd_ptr;
+	neg = *p == '-';
+	p += neg;
+
+	// 8 digits at a time while 8 bytes can be loaded
+	v = 0;
+	while (p + 8 <= _rd_end) {
+		memcpy((void *)&x, (void *)p, 8);
+		t = x - 0x3030303030303030ull;
+		m = (t | (t + 0x7676767676767676ull)) & 0x8080808080808080ull;
+		len = m == 0 ? 8 : __builtin_ctzll(m) / 8;
+		if (len == 0)
+			break;
+		v = v * _rd_pow10[len] + _rd_swar8(t, len);
+		p += len;
+		if (len < 8)
+			break;
+	}
+	while (p < _rd_end && (unsigned)(*p - '0') <= 9) {
+		v = v * 10 + (*p++ - '0');
+	}
+
+	_rd_ptr = p;
+	*num = (int)(neg ? (uint32_t)(0 - v) : (uint32_t)v);
+	return 1;
+}
+
+/* reads up to max numbers into arr, returns how many have been read */
+static inline int _readnums(int *arr, int max) {
+	long k;
+	int n = 0;
+
+	if (_rd_mode == 0)
+		_rd_open();
+
+	// binary, copy whole buffers
+	while (_rd_bin && n < max && _rd_left > 0) {
+		k = (_rd_end - _rd_ptr) / 4;
+		if (k > _rd_left)
+			k = _rd_left;
+		if (k > max - n)
+			k = max - n;
+		if (k == 0) {
+			if (_rd_eof)
+				break;
+			_rd_fill();
+			continue;
+		}
+		memcpy((void *)(arr + n), (void *)_rd_ptr, k * 4);
+		_rd_ptr += k * 4;
+		_rd_left -= k;
+		n += k;
+	}
+
+	while (n < max && _readnum(arr + n))
+		n++;
+
+	return n;
+}
+
+/* the numbers of a mmapped binary input in place, without a copy,
+   NULL when the input is text or not a file, or has been read from already */
+static inline int *_readbin(long *n) {
+	int *arr;
+
+	if (_rd_mode == 0)
+		_rd_open();
+	if (_rd_mode != 'm' || !_rd_bin || _rd_ptr != _rd_base + sizeof(struct _binhdr))
+		return NULL;
+
+	*n = _rd_left;
+	if (*n > (_rd_end - _rd_ptr) / 4)
+		*n = (_rd_end - _rd_ptr) / 4;
+	arr = (int *)_rd_ptr;
+	_rd_ptr += *n * 4;
+	_rd_left = 0;
+
+	return arr;
+}
+
+/* bytes of a number of the binary element type */
+static inline int _bin_size(uint32_t type) {
+	return type == BIN_INT64 || type == BIN_FLOAT64 ? 8 : 4;
+}
+
+/* reads the next text number of the type into num, returns 0 at the end of the input.
+   A number is a run of anything but white space and commas, converted with strtoul,
+   strtoll, strtof or strtod, which also take inf and nan */
+static inline int _readtyped(void *num, uint32_t type) {
+	char tok[RD_MAX_TOKEN + 1];
+	int len = 0;
+
+	if (_rd_mode == 0)
+		_rd_open();
+
+	for (;;) {
+		if (_rd_end - _rd_ptr < RD_MAX_TOKEN && !_rd_eof)
+			_rd_fill();
+		while (_rd_ptr < _rd_end && (*_rd_ptr == ',' || (unsigned)(*_rd_ptr - '\t') <= '\r' - '\t'
+				|| *_rd_ptr == ' '))
+			_rd_ptr++;
+		if (_rd_ptr < _rd_end)
+			break;
+		if (_rd_eof)
+			return 0;
+	}
+	while (_rd_ptr < _rd_end && len < RD_MAX_TOKEN && *_rd_ptr != ',' && *_rd_ptr != ' '
+			&& (unsigned)(*_rd_ptr - '\t') > '\r' - '\t')
+		tok[len++] = *_rd_ptr++;
+	tok[len] = '\0';
+
+	switch (type) {
+		case BIN_UINT32:
+			*(uint32_t *)num = (uint32_t)strtoul(tok, NULL, 10);
+			break;
+		case BIN_INT64:
+			*(int64_t *)num = (int64_t)strtoll(tok, NULL, 10);
+			break;
+		case BIN_FLOAT32:
+			*(float *)num = strtof(tok, NULL);
+			break;
+		case BIN_FLOAT64:
+			*(double *)num = strtod(tok, NULL);
+			break;
+	}
+	return 1;
+}
+
+/* reads the whole input of the element type: a mmapped binary file in place,
+   otherwise into a buffer that grows (n numbers, malloc'ed when *owned) */
+static inline void *_readall_typed(uint32_t type, long *n, int *owned) {
+	char *arr;
+	long cap, k;
+	int size = _bin_size(type);
+
+	_rd_typed = 1;
+	if (_rd_mode == 0)
+		_rd_open();
+	if (_rd_bin && _rd_type != type) {
+		fprintf(stderr, "the input has the element type %u, not %u\n", _rd_type, type);
+		exit(1);
+	}
+
+	*owned = 0;
+	if (_rd_bin && _rd_mode == 'm') {
+		*n = _rd_left;
+		if (*n > (_rd_end - _rd_ptr) / size)
+			*n = (_rd_end - _rd_ptr) / size;
+		arr = (char *)_rd_ptr;
+		_rd_ptr += *n * size;
+		_rd_left = 0;
+		return (void *)arr;
+	}
+
+	*owned = 1;
+	*n = 0;
+	cap = RD_TYPED_LEN;
+	arr = (char *)malloc(cap * size);
+	for (;;) {
+		if (arr == NULL) {
+			perror("malloc");
+			exit(1);
+		}
+		if (_rd_bin) {
+			// whole numbers of the buffer, then a refill
+			k = (_rd_end - _rd_ptr) / size;
+			if (k > _rd_left)
+				k = _rd_left;
+			if (k > cap - *n)
+				k = cap - *n;
+			memcpy((void *)(arr + *n * size), (void *)_rd_ptr, k * size);
+			_rd_ptr += k * size;
+			_rd_left -= k;
+			*n += k;
+			if (_rd_left == 0 || (k == 0 && _rd_eof))
+				break;
+			if (k == 0)
+				_rd_fill();
+		} else if (!_readtyped((void *)(arr + *n * size), type)) {
+			break;
+		} else {
+			(*n)++;
+		}
+		if (*n == cap) {
+			cap *= 2;
+			arr = (char *)realloc((void *)arr, cap * size);
+		}
+	}
+	return (void *)arr;
+}
+
+/* switches the input to the file descriptor fd, an input mmapped before stays mapped */
+static inline void _rd_reset(int fd) {
+	_rd_fd = fd;
+	_rd_mode = 0;
+	_rd_eof = 0;
+	_rd_bytes = 0;
+	_rd_bin = 0;
+	_rd_type = BIN_INT32;
+	_rd_left = 0;
+	free((void *)_rd_buf);
+	_rd_buf = NULL;
+}
+
+/* bytes of the input consumed so far */
+static inline long _rd_consumed() {
+	return _rd_bytes + (_rd_ptr - _rd_base);
+}
+
+static char _wr_buf[WR_BUF_LEN];
+static int _wr_len = 0;
+
+static const char _wr_digits[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+/* writes the buffer to stdout */
+static void _wr_flush() {
+	long n, off;
+
+	off = 0;
+	while (off < _wr_len) {
+		n = write(1, (void *)(_wr_buf + off), _wr_len - off);
+		if (n <= 0)
+			break;
+		off += n;
+	}
+	_wr_len = 0;
+}
+
+/* formats a number and a new line at p, up to WR_MAX_TOKEN bytes,
+   returns the end of the text */
+static inline char *_fmtnum(char *p, int num) {
+	char *e;
+	uint32_t v;
+	int len;
+
+	v = (uint32_t)num;
+	if (num < 0) {
+		*p++ = '-';
+		v = 0 - v;
+	}
+
+	len = v < 10 ? 1 : v < 100 ? 2 : v < 1000 ? 3 : v < 10000 ? 4 : v < 100000 ? 5 :
+		v < 1000000 ? 6 : v < 10000000 ? 7 : v < 100000000 ? 8 : v < 1000000000 ? 9 : 10;
+
+	// from the end, two digits at a time
+	e = p + len;
+	*e = '\n';
+	while (v >= 100) {
+		e -= 2;
+		memcpy((void *)e, (void *)(_wr_digits + 2 * (v % 100)), 2);
+		v /= 100;
+	}
+	if (v >= 10) {
+		memcpy((void *)(e - 2), (void *)(_wr_digits + 2 * v), 2);
+	} else {
+		*(e - 1) = '0' + v;
+	}
+
+	return p + len + 1;
+}
+
+/* writes a number and a new line */
+static inline void _writenum(int num) {
+	if (_wr_len > WR_BUF_LEN - WR_MAX_TOKEN)
+		_wr_flush();
+
+	_wr_len = (int)(_fmtnum(_wr_buf + _wr_len, num) - _wr_buf);
+}
+
+/* writes n numbers of arr, a number per line */
+static inline void _writenums(int *arr, int n) {
+	int i;
+
+	for (i = 0; i < n; i++)
+		_writenum(arr[i]);
+}
+
+/* writes the header of a binary output of n numbers of the element type */
+static inline void _writebin_typed_hdr(long n, uint32_t type) {
+	struct _binhdr h;
+
+	memcpy((void *)h.magic, BIN_MAGIC, 4);
+	h.type = type;
+	h.count = (uint64_t)n;
+
+	if (_wr_len > WR_BUF_LEN - (int)sizeof(h))
+		_wr_flush();
+	memcpy((void *)(_wr_buf + _wr_len), (void *)&h, sizeof(h));
+	_wr_len += sizeof(h);
+}
+
+/* writes the header of a binary output of n ints */
+static inline void _writebin_hdr(long n) {
+	_writebin_typed_hdr(n, BIN_INT32);
+}
+
+/* writes n numbers of the element type as text, a number per line; floats get
+   the digits that read back to the same value */
+static inline void _writetyped(const void *arr, long n, uint32_t type) {
+	long i;
+
+	for (i = 0; i < n; i++) {
+		if (_wr_len > WR_BUF_LEN - WR_MAX_TYPED)
+			_wr_flush();
+		switch (type) {
+			case BIN_UINT32:
+				_wr_len += snprintf(_wr_buf + _wr_len, WR_MAX_TYPED, "%u\n", ((const uint32_t *)arr)[i]);
+				break;
+			case BIN_INT64:
+				_wr_len += snprintf(_wr_buf + _wr_len, WR_MAX_TYPED, "%lld\n",
+					(long long)((const int64_t *)arr)[i]);
+				break;
+			case BIN_FLOAT32:
+				_wr_len += snprintf(_wr_buf + _wr_len, WR_MAX_TYPED, "%.9g\n", ((const float *)arr)[i]);
+				break;
+			case BIN_FLOAT64:
+				_wr_len += snprintf(_wr_buf + _wr_len, WR_MAX_TYPED, "%.17g\n", ((const double *)arr)[i]);
+				break;
+		}
+	}
+}
+
+/* writes a number of a binary output */
+static inline void _writeraw(int num) {
+	if (_wr_len > WR_BUF_LEN - 4)
+		_wr_flush();
+	memcpy((void *)(_wr_buf + _wr_len), (void *)&num, 4);
+	_wr_len += 4;
+}
+
+/* writes len bytes at p straight to stdout, after the buffer */
+static inline void _writebuf(const void *p, long len) {
+	const char *b;
+	long k;
+
+	_wr_flush();
+	b = (const char *)p;
+	while (len > 0) {
+		k = write(1, (void *)b, len < (1L << 30) ? len : (1L << 30));
+		if (k <= 0)
+			break;
+		b += k;
+		len -= k;
+	}
+}
+
+/* writes n numbers of arr as raw values straight from the array */
+static inline void _writeraws(int *arr, long n) {
+	_writebuf((const void *)arr, n * 4);
+}
+
+#endif
@@ -0,0 +1,433 @@
+/* Selection of order statistics of an array from stdin, text or binary,
+   without sorting all of it.
+   Usage: select -k 100 for the 100 smallest numbers, in ascending order
+   			(partial quicksort);
+   		-i N for the N-th smallest number, 1-based (introselect);
+   		-p 50,90,99.9 for percentiles, the nearest rank, in ascending order
+   			(a single multi-rank select for all of them);
+   		-r for the largest numbers with -k (in descending order) and -i;
+   		-s to keep the k numbers of -k in a heap while the input streams by,
+   			without storing it;
+   		-t to print the selection time to stderr;
+   		-n to skip printing the result, for benchmarking.
+   Without -s the whole array is read, a binary one is used in place. A quickselect
+   that keeps choosing bad pivots switches to the median of medians, so every mode
+   is linear in the worst case (plus k log k to sort the k numbers).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <sys/time.h>
+
+#include "numio.h"
+
+#define MAX_ARR_LEN 	100000000
+#define MAX_PERCENTILES	64
+#define SELECT_INSERT_LEN	16 // ranges finished with the insertion sort
+#define MOM_GROUP_LEN	5
+
+/* introselect, a[i] is the number of rank i of a[p..r], not greater ones before it */
+void _select(int*, int, int, int);
+void _select_multi(int*, int, int, int*, int, int);
+void _sort_partial(int*, int, int, int, int);
+
+/* partitioning */
+int _pivot(int*, int, int, int);
+int _partition(int*, int, int, int);
+int _mom(int*, int, int);
+void _sort_insert(int*, int, int);
+static inline int _log2(int);
+
+/* streaming top k, a max-heap of the k smallest numbers seen so far */
+int _stream_top(int*, int, int);
+static inline void _sift_down(int*, int, int);
+
+int _cmp_double(const void*, const void*);
+
+int main(int argc, char const *argv[])
+{
+	double pcts[MAX_PERCENTILES];
+	int ranks[MAX_PERCENTILES];
+	const char *s;
+	char *e;
+	int *arr;
+	long cnt, k = 0, rank = 0;
+	int reverse = 0, stream = 0, timing = 0, output = 1;
+	int npct = 0;
+	int i, n, num;
+	struct timeval t1, t2;
+	double elapsed, x;
+
+	while (--argc > 0) {
+		++argv;
+		if (*(*argv)++ != '-')
+			continue;
+		switch (**argv) {
+			case 'k':
+				// either -k100 or -k 100
+				if (*++(*argv) == '\0' && argc > 1) {
+					--argc;
+					++argv;
+				}
+				k = atol(*argv);
+				if (k <= 0 || k > MAX_ARR_LEN) {
+					printf("k must be a positive number up to %d.\n", MAX_ARR_LEN);
+					return 1;
+				}
+				break;
+			case 'i':
+				if (*++(*argv) == '\0' && argc > 1) {
+					--argc;
+					++argv;
+				}
+				rank = atol(*argv);
+				if (rank <= 0) {
+					printf("rank must be a positive number.\n");
+					return 1;
+				}
+				break;
+			case 'p':
+				if (*++(*argv) == '\0' && argc > 1) {
+					--argc;
+					++argv;
+				}
+				for (s = *argv; *s != '\0' && npct < MAX_PERCENTILES; s = *e == ',' ? e + 1 : e) {
+					pcts[npct] = strtod(s, &e);
+					if (e == s || pcts[npct] < 0 || pcts[npct] > 100) {
+						printf("percentiles must be numbers from 0 to 100, separated by commas.\n");
+						return 1;
+					}
+					npct++;
+				}
+				break;
+			case 'r':
+				reverse = 1;
+				break;
+			case 's':
+				stream = 1;
+				break;
+			case 't':
+				timing = 1;
+				break;
+			case 'n':
+				output = 0;
+				break;
+			default:
+				printf("unknown option %s\n", *argv);
+				return 1;
+		}
+	}
+
+	if ((k > 0) + (rank > 0) + (npct > 0) != 1 || (stream && k == 0)) {
+		printf("usage: select [-r] [-s] [-t] [-n] -k 100 | -i 500 | -p 50,90,99.9\n");
+		return 1;
+	}
+
+	// the k smallest of the numbers read one at a time, the heap is sorted in place
+	if (stream) {
+		arr = (int *)malloc(k * sizeof(int));
+		gettimeofday(&t1, NULL);
+		n = _stream_top(arr, (int)k, reverse);
+		if (reverse) {
+			for (i = 0; i < n; i++)
+				arr[i] = ~arr[i];
+		}
+		gettimeofday(&t2, NULL);
+
+		if (timing) {
+			elapsed = (t2.tv_sec - t1.tv_sec) * 1000.0;     // sec to ms
+			elapsed += (t2.tv_usec - t1.tv_usec) / 1000.0;  // us to ms
+			fprintf(stderr, "read and selected in %fms\n", elapsed);
+		}
+		if (output) {
+			_writenums(arr, n);
+			_wr_flush();
+		}
+		return 0;
+	}
+
+	// read an array from stdin, a binary file is used in place
+	arr = _readbin(&cnt);
+	if (arr != NULL) {
+		if (cnt > INT_MAX) {
+			printf("binary input of %ld numbers is too big\n", cnt);
+			return 1;
+		}
+		n = (int)cnt;
+	} else {
+		arr = (int *)malloc(MAX_ARR_LEN * sizeof(int));
+		n = _readnums(arr, MAX_ARR_LEN);
+		if (n == MAX_ARR_LEN && _readnum(&num)) {
+			fprintf(stderr, "warning: only the first %d numbers are read, use -s for bigger inputs\n",
+				MAX_ARR_LEN);
+		}
+	}
+	if (n == 0) {
+		printf("the input is empty.\n");
+		return 1;
+	}
+
+	gettimeofday(&t1, NULL);
+
+	// ~x reverses the order of ints, the largest numbers become the smallest
+	if (reverse && npct == 0) {
+		for (i = 0; i < n; i++)
+			arr[i] = ~arr[i];
+	}
+
+	if (k > 0) {
+		if (k > n)
+			k = n;
+		_sort_partial(arr, 0, n - 1, (int)k, 2 * _log2(n));
+		if (reverse) {
+			for (i = 0; i < k; i++)
+				arr[i] = ~arr[i];
+		}
+		n = (int)k;
+	} else if (rank > 0) {
+		if (rank > n) {
+			printf("rank %ld is out of the array of size %d.\n", rank, n);
+			return 1;
+		}
+		_select(arr, 0, n - 1, (int)rank - 1);
+		if (reverse)
+			arr[rank - 1] = ~arr[rank - 1];
+	} else {
+		// nearest rank, the smallest number with at least p% of the numbers not greater
+		qsort(pcts, npct, sizeof(double), _cmp_double);
+		for (i = 0; i < npct; i++) {
+			// ceil(p n / 100) - 1, p n / 100 may be off by a rounding error
+			x = pcts[i] / 100 * n;
+			ranks[i] = (int)x;
+			if (x - ranks[i] > x * 1e-12)
+				ranks[i]++;
+			ranks[i]--;
+			if (ranks[i] < 0)
+				ranks[i] = 0;
+			if (ranks[i] > n - 1)
+				ranks[i] = n - 1;
+		}
+		_select_multi(arr, 0, n - 1, ranks, npct, 2 * _log2(n));
+	}
+	gettimeofday(&t2, NULL);
+
+	if (timing) {
+		elapsed = (t2.tv_sec - t1.tv_sec) * 1000.0;     // sec to ms
+		elapsed += (t2.tv_usec - t1.tv_usec) / 1000.0;  // us to ms
+		fprintf(stderr, "selected in %fms\n", elapsed);
+	}
+	if (!output)
+		return 0;
+
+	if (k > 0) {
+		_writenums(arr, n);
+		_wr_flush();
+	} else if (rank > 0) {
+		printf("%d\n", arr[rank - 1]);
+	} else {
+		for (i = 0; i < npct; i++)
+			printf("%g %d\n", pcts[i], arr[ranks[i]]);
+	}
+
+	return 0;
+}
+
+void _select(int *a, int p, int r, int i) {
+	int bad = 2 * _log2(r - p + 1);
+	int j;
+
+	while (r - p + 1 > SELECT_INSERT_LEN) {
+		j = _partition(a, p, r, _pivot(a, p, r, bad--));
+		if (i <= j) {
+			r = j;
+		} else {
+			p = j + 1;
+		}
+	}
+	_sort_insert(a, p, r);
+}
+
+/* selects all the m ranks, sorted, within a[p..r]: a partition serves
+   the ranks on both of its sides */
+void _select_multi(int *a, int p, int r, int *ranks, int m, int bad) {
+	int j, l;
+
+	while (m > 0) {
+		if (m == 1) {
+			_select(a, p, r, ranks[0]);
+			return;
+		}
+		if (r - p + 1 <= SELECT_INSERT_LEN) {
+			_sort_insert(a, p, r);
+			return;
+		}
+
+		j = _partition(a, p, r, _pivot(a, p, r, bad--));
+		for (l = 0; l < m && ranks[l] <= j; l++);
+
+		// the side with fewer ranks first
+		if (l < m - l) {
+			_select_multi(a, p, j, ranks, l, bad);
+			p = j + 1;
+			ranks += l;
+			m -= l;
+		} else {
+			_select_multi(a, j + 1, r, ranks + l, m - l, bad);
+			r = j;
+			m = l;
+		}
+	}
+}
+
+/* partial quicksort, sorts the k smallest numbers of a[p..r] into a[p..p+k-1],
+   a partition past them is not sorted any further */
+void _sort_partial(int *a, int p, int r, int k, int bad) {
+	int j;
+
+	k += p;
+	while (r - p + 1 > SELECT_INSERT_LEN) {
+		if (p >= k)
+			return;
+		j = _partition(a, p, r, _pivot(a, p, r, bad--));
+		_sort_partial(a, p, j, j + 1 - p < k - p ? j + 1 - p : k - p, bad);
+		p = j + 1;
+	}
+	if (p < k)
+		_sort_insert(a, p, r);
+}
+
+/* the position of a pivot of a[p..r], the median of the first, middle and last
+   numbers, or the median of medians once bad is spent */
+int _pivot(int *a, int p, int r, int bad) {
+	int q = p + (r - p) / 2;
+
+	if (bad <= 0)
+		return _mom(a, p, r);
+	if (a[p] < a[q]) {
+		if (a[q] < a[r])
+			return q;
+		return a[p] < a[r] ? r : p;
+	}
+	if (a[p] < a[r])
+		return p;
+	return a[q] < a[r] ? r : q;
+}
+
+/* Hoare partition around a[s], returns j with a[p..j] <= a[s] <= a[j+1..r], p <= j < r */
+int _partition(int *a, int p, int r, int s) {
+	int i, j, x, t;
+
+	x = a[s];
+	a[s] = a[p];
+	a[p] = x;
+
+	i = p - 1;
+	j = r + 1;
+	for (;;) {
+		do {
+			j--;
+		} while (a[j] > x);
+		do {
+			i++;
+		} while (a[i] < x);
+		if (i >= j)
+			return j;
+		t = a[i];
+		a[i] = a[j];
+		a[j] = t;
+	}
+}
+
+/* the median of medians of groups of 5, the pivot leaves at least 3/10
+   of a[p..r] on either side; the medians are moved to the front */
+int _mom(int *a, int p, int r) {
+	int g, q, t, m;
+
+	m = p;
+	for (g = p; g + MOM_GROUP_LEN - 1 <= r; g += MOM_GROUP_LEN) {
+		_sort_insert(a, g, g + MOM_GROUP_LEN - 1);
+		q = g + MOM_GROUP_LEN / 2;
+		t = a[q];
+		a[q] = a[m];
+		a[m++] = t;
+	}
+	if (m == p)
+		return p + (r - p) / 2;
+
+	q = p + (m - 1 - p) / 2;
+	_select(a, p, m - 1, q);
+	return q;
+}
+
+void _sort_insert(int *a, int p, int r) {
+	int i, j, key;
+
+	for (j = p + 1; j <= r; j++) {
+		key = a[j];
+		i = j - 1;
+		while (i >= p && a[i] > key) {
+			a[i + 1] = a[i];
+			i--;
+		}
+		a[i + 1] = key;
+	}
+}
+
+static inline int _log2(int n) {
+	return n > 1 ? 31 - __builtin_clz(n) : 0;
+}
+
+/* reads the numbers one at a time keeping the k smallest in a max-heap at h,
+   then sorts the heap in place, returns how many numbers it holds;
+   the numbers are read as ~x with reverse */
+int _stream_top(int *h, int k, int reverse) {
+	int n, m, num, t;
+
+	n = 0;
+	while (n < k && _readnum(&num)) {
+		h[n] = reverse ? ~num : num;
+		// sift up
+		for (m = n++; m > 0 && h[(m - 1) / 2] < h[m]; m = (m - 1) / 2) {
+			t = h[m];
+			h[m] = h[(m - 1) / 2];
+			h[(m - 1) / 2] = t;
+		}
+	}
+	while (_readnum(&num)) {
+		if (reverse)
+			num = ~num;
+		if (num < h[0]) {
+			h[0] = num;
+			_sift_down(h, 0, n);
+		}
+	}
+
+	// heapsort, the max goes to the end
+	for (m = n - 1; m > 0; m--) {
+		t = h[0];
+		h[0] = h[m];
+		h[m] = t;
+		_sift_down(h, 0, m);
+	}
+	return n;
+}
+
+static inline void _sift_down(int *h, int i, int n) {
+	int c, x = h[i];
+
+	while ((c = 2 * i + 1) < n) {
+		if (c + 1 < n && h[c + 1] > h[c])
+			c++;
+		if (h[c] <= x)
+			break;
+		h[i] = h[c];
+		i = c;
+	}
+	h[i] = x;
+}
+
+int _cmp_double(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
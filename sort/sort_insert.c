@@ -1,32 +1,47 @@
-/* Insertion sort algorithm implementation for an uint array, read from stdin */
+/* Insertion sort algorithm implementation for an uint array, read from stdin.
+   Options: -n to skip printing the result, for benchmarking.
+ */
 
 #include <stdio.h>
 #include <stdlib.h>
 
-#define MAX_BUF_LEN 12
+#include "numio.h"
+
 #define MAX_ARR_LEN 1000000
 
-int _getnum();
 void _sort_insert(int *arr, int n);
 
+int _output = 1;
+
 int main(int argc, char const *argv[])
 {
+	while (--argc > 0) {
+		++argv;
+		if (*(*argv)++ != '-')
+			continue;
+		switch (**argv) {
+			case 'n':
+				_output = 0;
+				break;
+			default: 
+				printf("unknown option %s\n", *argv);
+				return 1;
+		}
+	}
+
 	int arr[MAX_ARR_LEN];
 	int i = 0;
-	int num;
 
 	// read an array from stdin
-	while ((num = _getnum()) != EOF && i < MAX_ARR_LEN) {
-		arr[i++] = num;
-	}
+	i = _readnums(arr, MAX_ARR_LEN);
 
 	// sort the array using insertion sort algorithm
 	_sort_insert(arr, i);
 
 	// print the result
-	int n = i;
-	for (i = 0; i < n; i++) {
-		printf("%d\n", arr[i]);
+	if (_output) {
+		_writenums(arr, i);
+		_wr_flush();
 	}
 
 	return 0;
@@ -42,27 +57,3 @@ void _sort_insert(int *arr, int n) {
 		arr[j + 1] = k;
 	}
 }
-
-char _buf[MAX_BUF_LEN];
-int _getnum() {
-	int c;
-	char *ptr = _buf;
-
-	// skip spaces until we get a start of a new number
-	for (c = getchar(); c == '\n' || c == ' '; c = getchar());
-
-	// read chars of a number
-	while (c != EOF && c != '\n' && c != ' ' 
-		&& ptr < _buf + MAX_BUF_LEN - 1) {
-		*ptr++ = c;
-		c = getchar();
-	}
-
-	*ptr = '\0';
-
-	if (ptr == _buf && c == EOF) {
-		return EOF;
-	}
-
-	return atoi(_buf);
-}
\ No newline at end of file
@@ -0,0 +1,167 @@
+/* Sort kernels for any key type, specialized at compile time.
+   SORT_KERNELS(T, S, U, KEY) defines for the keys of type T:
+   		_sort_insert_S(T *a, long n), the insertion sort;
+   		_sort_merge_S(T *a, long n), a bottom-up merge sort, runs of KERNEL_INSERT_LEN
+   			sorted with the insertion sort, then passes between a and a scratch buffer;
+   		_sort_radix_S(T *a, long n), an LSD radix sort with 8-bit digits of KEY(x),
+   			where U is the unsigned type of the size of T and KEY maps T to U
+   			preserving the order.
+   Every specialization has its own inner loops, with the comparisons and
+   the key transform of its type inlined. The merge takes no sentinel, so
+   the max value of a type sorts like any other. All the kernels compare KEY(x),
+   a total order: NaNs go below -inf or above +inf by their sign, -0.0 before 0.0.
+   A plain < on floats is not one, and the merge bounds only one of its parts,
+   so it relies on that order to stay within the runs.
+ */
+
+#ifndef SORT_KERNELS_H
+#define SORT_KERNELS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KERNEL_INSERT_LEN	32
+#define KERNEL_RADIX_BITS	8
+#define KERNEL_RADIX_SIZE	(1 << KERNEL_RADIX_BITS)
+
+/* order-preserving keys: the sign bit flipped for signed ints, all the bits
+   flipped for negative floats and the sign bit for the others */
+static inline uint32_t _key_i32(int32_t x) {
+	return (uint32_t)x ^ 0x80000000u;
+}
+
+static inline uint32_t _key_u32(uint32_t x) {
+	return x;
+}
+
+static inline uint64_t _key_i64(int64_t x) {
+	return (uint64_t)x ^ 0x8000000000000000ull;
+}
+
+static inline uint32_t _key_f32(float x) {
+	uint32_t u;
+
+	memcpy((void *)&u, (void *)&x, 4);
+	return u ^ ((uint32_t)((int32_t)u >> 31) | 0x80000000u);
+}
+
+static inline uint64_t _key_f64(double x) {
+	uint64_t u;
+
+	memcpy((void *)&u, (void *)&x, 8);
+	return u ^ ((uint64_t)((int64_t)u >> 63) | 0x8000000000000000ull);
+}
+
+#define SORT_KERNELS(T, S, U, KEY)												\
+																				\
+static inline void _sort_insert_##S(T *a, long n) {									\
+	long i, j;																	\
+	T k;																		\
+	U u;																		\
+																				\
+	for (i = 1; i < n; i++) {													\
+		k = a[i];																\
+		u = KEY(k);																\
+		for (j = i - 1; j >= 0 && u < KEY(a[j]); j--)							\
+			a[j + 1] = a[j];													\
+		a[j + 1] = k;															\
+	}																			\
+}																				\
+																				\
+/* merges [p, q) and [q, r) of src into dst, the part with the smaller last		\
+   key runs out first, the last key of the other part bounds the loop */		\
+static inline void _merge_##S(T *src, T *dst, long p, long q, long r) {				\
+	long i = p, j = q, k = p;													\
+																				\
+	if (KEY(src[r - 1]) < KEY(src[q - 1])) {									\
+		while (j < r)															\
+			dst[k++] = KEY(src[j]) < KEY(src[i]) ? src[j++] : src[i++];			\
+		memcpy((void *)(dst + k), (void *)(src + i), (q - i) * sizeof(T));		\
+	} else {																	\
+		while (i < q)															\
+			dst[k++] = KEY(src[j]) < KEY(src[i]) ? src[j++] : src[i++];			\
+		memcpy((void *)(dst + k), (void *)(src + j), (r - j) * sizeof(T));		\
+	}																			\
+}																				\
+																				\
+static inline void _sort_merge_##S(T *a, long n) {										\
+	T *src, *dst, *t;															\
+	long p, q, r, len;															\
+																				\
+	for (p = 0; p < n; p += KERNEL_INSERT_LEN)									\
+		_sort_insert_##S(a + p, n - p < KERNEL_INSERT_LEN ? n - p : KERNEL_INSERT_LEN);	\
+	if (n <= KERNEL_INSERT_LEN)													\
+		return;																	\
+																				\
+	src = a;																	\
+	dst = (T *)malloc(n * sizeof(T));											\
+	for (len = KERNEL_INSERT_LEN; len < n; len *= 2) {							\
+		for (p = 0; p < n; p += 2 * len) {										\
+			q = p + len < n ? p + len : n;										\
+			r = p + 2 * len < n ? p + 2 * len : n;								\
+			if (q < r)															\
+				_merge_##S(src, dst, p, q, r);									\
+			else																\
+				memcpy((void *)(dst + p), (void *)(src + p), (r - p) * sizeof(T));	\
+		}																		\
+		t = src;																\
+		src = dst;																\
+		dst = t;																\
+	}																			\
+																				\
+	if (src != a) {																\
+		memcpy((void *)a, (void *)src, n * sizeof(T));							\
+		free((void *)src);														\
+	} else {																	\
+		free((void *)dst);														\
+	}																			\
+}																				\
+																				\
+/* counts all the digits in one pass, skips the passes where every key			\
+   has the same digit */														\
+static inline void _sort_radix_##S(T *a, long n) {										\
+	long cnt[sizeof(U)][KERNEL_RADIX_SIZE];										\
+	long sum, c, i;																\
+	T *src, *dst, *tmp, *t;														\
+	U k;																		\
+	int d, b, s;																\
+																				\
+	if (n <= 1)																	\
+		return;																	\
+																				\
+	memset((void *)cnt, 0, sizeof(cnt));										\
+	for (i = 0; i < n; i++) {													\
+		k = KEY(a[i]);															\
+		for (d = 0; d < (int)sizeof(U); d++)									\
+			cnt[d][(k >> (d * KERNEL_RADIX_BITS)) & (KERNEL_RADIX_SIZE - 1)]++;	\
+	}																			\
+																				\
+	tmp = (T *)malloc(n * sizeof(T));											\
+	src = a;																	\
+	dst = tmp;																	\
+	for (d = 0; d < (int)sizeof(U); d++) {										\
+		s = d * KERNEL_RADIX_BITS;												\
+		if (cnt[d][(KEY(a[0]) >> s) & (KERNEL_RADIX_SIZE - 1)] == n)			\
+			continue;															\
+																				\
+		sum = 0;																\
+		for (b = 0; b < KERNEL_RADIX_SIZE; b++) {								\
+			c = cnt[d][b];														\
+			cnt[d][b] = sum;													\
+			sum += c;															\
+		}																		\
+		for (i = 0; i < n; i++)													\
+			dst[cnt[d][(KEY(src[i]) >> s) & (KERNEL_RADIX_SIZE - 1)]++] = src[i];	\
+																				\
+		t = src;																\
+		src = dst;																\
+		dst = t;																\
+	}																			\
+																				\
+	if (src != a)																\
+		memcpy((void *)a, (void *)src, n * sizeof(T));							\
+	free((void *)tmp);															\
+}
+
+#endif
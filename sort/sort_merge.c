@@ -1,24 +1,89 @@
 /* Merge sort algorithm, read from stdin.
-   Options: -Os for sentinel optimization;
-   			-Oi for insertion sort on smaller sub-arrays optimization;
+   Options: -Os for the merge bounded by a single check: the part with the smaller
+   				last number runs out first, only its index is checked;
+   			-Oi for insertion sort on smaller sub-arrays optimization
+   				(an AVX2 sorting network when the CPU supports it);
+   			-Ob for bottom-up merge sort with a single scratch buffer;
+   			-Op for parallel fork-join merge sort, -j N to set the number of threads;
+   			-Or for LSD radix sort, multithreaded scatter with -j N;
+   			-Oa for adaptive natural merge sort with galloping;
+   			-Oq for in-place pattern-defeating quicksort (pdqsort), unstable;
+   			-OS for parallel sample sort, unstable, -j N to set the number of threads;
+   			-Ow for in-place stable block merge sort (GrailSort), the internal buffer
+   				is taken from the distinct numbers of the input, a fixed buffer of 512
+   				numbers speeds up the first passes, -OwN for N (up to 4096), -Ow0 for none;
+   			-Ok for multiway merge sort, blocks of the L2 cache size merged 16 at a time
+   				through a loser tree, -OkN to merge N (2 to 64);
+   			-Oe for external merge sort of inputs bigger than the memory,
+   				-m N to set the memory budget in MB;
+   			-Mb for the branchless merge, -Mv for the AVX2 merge, in all merge sort modes;
+   			-t to print the sorting time to stderr;
+   			-n to skip printing the result, for benchmarking;
+   			-b to print the result in the binary format of numio.h;
+   			-T u|l|f|d to sort uint32, int64, float or double numbers instead of ints,
+   				text or a binary input of that element type, with the merge sort
+   				of sort_kernels.h (-Or for its radix sort);
+   			-B N to benchmark every sort kernel in-process instead, on sizes from 100
+   				to N (BENCH_MAX_LEN by default) and several input distributions,
+   				-Fc for CSV output (default), -Fj for JSON.
+   The input is either text or binary, a binary file is sorted in place without
+   the MAX_ARR_LEN limit. The size of the sub-arrays sorted without merging is
+   insert_sort_len of the tuning file (tuning.h, written by merge_insert_x).
+   Build with -pthread -lm.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <immintrin.h>
 
-#define MAX_BUF_LEN 	12
-#define MAX_ARR_LEN 	10000000
-#define INF				(1u << 31) - 1
-#define INSERT_SORT_LEN	64 // array size to sort with the insertion sort
+#include "numio.h"
+#include "sort_net.h"
+#include "sort_kernels.h"
+#include "tuning.h"
 
-int _getnum();
+#define MAX_ARR_LEN 	10000000
+#define INSERT_SORT_LEN	64 // array size to sort with the insertion sort, unless tuned
+#define PARALLEL_LEN	65536 // array size to sort or merge in a single task
+#define MIN_GALLOP		7 // wins in a row to start galloping
+#define RUN_STACK_LEN	64
+#define EXT_MEM_MB		256 // default memory budget of the external sort
+#define EXT_MIN_BUF_LEN	(1 << 20) // min buffer size of a run being merged, bytes
+#define EXT_MAX_FANIN	256
+#define EXT_MAX_CHUNK	(INT_MAX / 4) // numbers of a run, the int indices of -Ob stay in range
+#define RADIX_BITS		8
+#define RADIX_SIZE		(1 << RADIX_BITS)
+#define RADIX_PASSES	(32 / RADIX_BITS)
+#define PDQ_INSERT_LEN	24 // ranges sorted with the insertion sort
+#define PDQ_NINTHER_LEN	128 // ranges with a pseudomedian of 9 pivot
+#define PDQ_BLOCK_LEN	64 // offsets buffered by a side of the block partition
+#define PDQ_PARTIAL_MOVES	8 // moves before the partial insertion sort gives up
+#define IP_BUF_LEN		512 // fixed buffer of the in-place block merge sort
+#define IP_BUF_MAX_LEN	4096
+#define MW_FANIN		16 // runs merged at a time by the multiway merge sort
+#define MW_MAX_FANIN	64
+#define MW_L2_SIZE		(1 << 18) // L2 cache size in bytes, unless the system tells
+#define MW_DONE			UINT64_MAX // key of a run that is over
+#define SAMPLE_LOG		8 // log2 of the number of splitter buckets
+#define SAMPLE_BUCKETS	(1 << SAMPLE_LOG)
+#define SAMPLE_OVERSAMPLE	32 // sample size per bucket for the splitters
+#define SAMPLE_UNROLL	8 // numbers going down the splitter tree together
+#define BENCH_MAX_LEN	100000000
+#define BENCH_WORK		10000000 // numbers sorted for a size, in as many runs as they take
+#define BENCH_MAX_RUNS	101
+#define RADIX_DIGIT(x, s)	((((unsigned)(x) ^ 0x80000000u) >> (s)) & (RADIX_SIZE - 1))
 
 /* classic merge sort */
 void _sort_merge(int*, int, int);
 void _merge(int*, int, int, int);
 
-/* optimized with sentinels */
+/* optimized with a single bound, the part with the smaller last number */
 void _sort_merge_s(int*, int, int);
 void _merge_s(int*, int, int, int);
 
@@ -26,10 +91,203 @@ void _merge_s(int*, int, int, int);
 void _sort_merge_i(int*, int, int);
 void _sort_insert(int*, int, int);
 
+/* sorting networks for the smaller sub-arrays */
+void _sort_net(int*, int, int);
+
+/* merge strategies */
+void _merge_kernel(int*, int, int*, int, int*);
+void _merge_nb(int*, int, int*, int, int*);
+void _merge_avx2(int*, int, int*, int, int*);
+
+/* bottom-up, ping-pong between the array and a single scratch buffer */
+void _sort_merge_b(int*, int);
+void _merge_b(int*, int*, int, int, int);
+
+/* adaptive, merges natural runs */
+void _sort_merge_a(int*, int);
+int _find_run(int*, int, int, int);
+int _node_power(int, int, int, int);
+void _merge_a(int*, int, int, int, int*);
+int _gallop_right(int, int*, int);
+int _gallop_left(int, int*, int);
+
+/* external, sorted runs in temp files */
+struct _erun {
+	FILE *f;
+	int *buf;
+	int len, pos;	// numbers in the buffer and the next one to merge, len is 0 at the end
+};
+
+void _sort_external(long);
+void _merge_runs(struct _erun*, int, int*, int, FILE*);
+int _lt_build(struct _erun*, int*, int, int);
+int _lt_less(struct _erun*, int, int);
+void _run_fill(struct _erun*, int);
+void _run_flush(int*, int, FILE*);
+
+/* parallel fork-join, tasks run by a pool of threads */
+struct _ptask {
+	char kind;		// 's' to sort a[p..r], 'm' to merge a[p..q] and a[q+1..r], 'c' to copy back,
+					// 'h' to count digits of a[p..r] at shift q, 'x' to scatter them to tmp,
+					// 'g' to count buckets of a[p..r], 'd' to scatter them to tmp,
+					// 'u' to sort the bucket tmp[p..r] and copy it back
+	int *a, *tmp;
+	int p, q, r;
+	int k1, k2;		// output positions [k1, k2) of a merge segment, relative to p
+	int done;
+	struct _ptask *next;
+	unsigned *cnt;	// digit counts, then output positions of a radix chunk
+};
+
+void _sort_merge_p(int*, int);
+void _psort(int*, int*, int, int);
+void _pmerge(int*, int*, int, int, int);
+int _corank(int, int*, int, int*, int);
+void _pool_start(int);
+void _pool_stop();
+void _pool_push(struct _ptask*);
+void _pool_join(struct _ptask*);
+void _pool_run(struct _ptask*);
+void *_pool_worker(void*);
+
+/* LSD radix sort, digits of RADIX_BITS */
+void _sort_radix(int*, int);
+void _sort_radix_p(int*, int*, int);
+
+/* sample sort, buckets between oversampled splitters, sorted in parallel */
+void _sort_sample(int*, int);
+void _sample_splitters(int*, int);
+void _sample_pass(int*, int, int, unsigned*, int*);
+
+/* in-place stable merge sort, O(1) extra memory */
+void _sort_inplace(int*, int);
+int _ip_find_keys(int*, int, int);
+void _ip_build_blocks(int*, int, int);
+void _ip_combine_blocks(int*, int*, int, int, int, int);
+void _ip_merge_blocks(int*, int, int*, int, int, int, int, int);
+void _ip_smart_merge(int*, int*, int*, int, int);
+void _ip_smart_merge_nb(int*, int*, int*, int);
+void _ip_merge_left(int*, int, int, int);
+void _ip_merge_left_x(int*, int, int, int);
+void _ip_merge_right(int*, int, int, int);
+void _ip_merge_nb(int*, int, int);
+void _ip_lazy_sort(int*, int);
+void _ip_rotate(int*, int, int);
+void _ip_swap_n(int*, int*, int);
+
+/* multiway merge sort, blocks of half the L2 cache merged k at a time through
+   a loser tree of 64-bit keys: the order-preserving number, then the run index */
+void _sort_multiway(int*, int);
+void _mw_merge(int*, int*, long*, int);
+uint64_t _mw_build(uint64_t*, uint64_t*, int, int);
+
+/* pattern-defeating quicksort, in place, on the half-open range [begin, end) */
+void _sort_pdq(int*, int);
+void _pdq_loop(int*, int*, int, int);
+int *_pdq_partition_right(int*, int*, int*);
+int *_pdq_partition_left(int*, int*);
+int _pdq_partial_insert(int*, int*);
+void _pdq_sort3(int*, int*, int*);
+void _sort_heap(int*, int*);
+
+/* sort kernels, the modes of -O and the benchmark */
+struct _kernel {
+	char opt;			// the -O letter, '0' for the classic merge sort, ' ' for the benchmark only
+	const char *name;
+	void (*sort)(int*, int);
+	int max_n;			// the benchmark skips bigger sizes, 0 for no limit
+};
+
+void _k_insert(int*, int);
+void _k_merge(int*, int);
+void _k_merge_s(int*, int);
+void _k_merge_i(int*, int);
+
+struct _kernel _kernels[] = {
+	{' ', "insert", _k_insert, 10000},
+	{'0', "merge", _k_merge, 0},
+	{'s', "merge_s", _k_merge_s, 0},
+	{'i', "merge_i", _k_merge_i, 0},
+	{'b', "merge_b", _sort_merge_b, 0},
+	{'p', "merge_p", _sort_merge_p, 0},
+	{'r', "radix", _sort_radix, 0},
+	{'a', "merge_a", _sort_merge_a, 0},
+	{'q', "pdq", _sort_pdq, 0},
+	{'S', "sample", _sort_sample, 0},
+	{'w', "inplace", _sort_inplace, 0},
+	{'k', "multiway", _sort_multiway, 0},
+	{0, NULL, NULL, 0}
+};
+
+/* other element types, -T: the kernels of sort_kernels.h, picked once by the type */
+struct _ktype {
+	char opt;
+	uint32_t bin;		// BIN_* type of numio.h
+	void (*merge)(void*, long);
+	void (*radix)(void*, long);
+};
+
+int _sort_typed(char);
+
+#define TYPED_KERNELS(T, S, U, KEY)												\
+																				\
+SORT_KERNELS(T, S, U, KEY)														\
+																				\
+static void _t_merge_##S(void *a, long n) {										\
+	_sort_merge_##S((T *)a, n);													\
+}																				\
+																				\
+static void _t_radix_##S(void *a, long n) {										\
+	_sort_radix_##S((T *)a, n);													\
+}
+
+TYPED_KERNELS(uint32_t, u32, uint32_t, _key_u32)
+TYPED_KERNELS(int64_t, i64, uint64_t, _key_i64)
+TYPED_KERNELS(float, f32, uint32_t, _key_f32)
+TYPED_KERNELS(double, f64, uint64_t, _key_f64)
+
+struct _ktype _ktypes[] = {
+	{'u', BIN_UINT32, _t_merge_u32, _t_radix_u32},
+	{'l', BIN_INT64, _t_merge_i64, _t_radix_i64},
+	{'f', BIN_FLOAT32, _t_merge_f32, _t_radix_f32},
+	{'d', BIN_FLOAT64, _t_merge_f64, _t_radix_f64},
+	{0, 0, NULL, NULL}
+};
+
+/* benchmark */
+int _bench(long, char);
+void _bench_gen(int*, long, char);
+static inline uint64_t _bench_hash(uint64_t);
+void _rss_reset();
+long _rss_peak();
+
+// splitters of the sample sort: sorted, and in the BFS order of a tree from 1
+int _spl[SAMPLE_BUCKETS], _spl_tree[SAMPLE_BUCKETS];
+
 char _opt = '0';
+char _type = 'i';
+char _mstrat = '0';
+int _avx2 = 0;
+int _timing = 0;
+int _output = 1;
+int _binary = 0;
+int _nthreads = 0;
+int _insert_len = INSERT_SORT_LEN;
+int _ip_buf_len = IP_BUF_LEN;
+int _ip_buf[IP_BUF_MAX_LEN];
+int _mw_fanin = MW_FANIN;
+long _bench_len = 0;
+char _bench_fmt = 'c';
+long _ext_mem = EXT_MEM_MB;
+long _ext_read = 0, _ext_written = 0;
 
 int main(int argc, char const *argv[])
 {
+	_avx2 = __builtin_cpu_supports("avx2");
+	_insert_len = (int)_tuned("insert_sort_len", INSERT_SORT_LEN);
+	if (_insert_len < 2)
+		_insert_len = INSERT_SORT_LEN;
+
 	while (--argc > 0) {
 		++argv;
 		if (*(*argv)++ != '-')
@@ -43,43 +301,262 @@ int main(int argc, char const *argv[])
 					case 'i':
 						_opt = 'i';
 						break;
+					case 'b':
+						_opt = 'b';
+						break;
+					case 'p':
+						_opt = 'p';
+						break;
+					case 'r':
+						_opt = 'r';
+						break;
+					case 'a':
+						_opt = 'a';
+						break;
+					case 'e':
+						_opt = 'e';
+						break;
+					case 'q':
+						_opt = 'q';
+						break;
+					case 'S':
+						_opt = 'S';
+						break;
+					case 'w':
+						// either -Ow or -Ow256
+						_opt = 'w';
+						if ((*argv)[1] >= '0' && (*argv)[1] <= '9')
+							_ip_buf_len = atoi(*argv + 1);
+						if (_ip_buf_len > IP_BUF_MAX_LEN) {
+							printf("in-place merge buffer is up to %d numbers.\n", IP_BUF_MAX_LEN);
+							return 1;
+						}
+						break;
+					case 'k':
+						// either -Ok or -Ok64
+						_opt = 'k';
+						if ((*argv)[1] >= '0' && (*argv)[1] <= '9')
+							_mw_fanin = atoi(*argv + 1);
+						if (_mw_fanin < 2 || _mw_fanin > MW_MAX_FANIN) {
+							printf("multiway merge fan-in must be from 2 to %d.\n", MW_MAX_FANIN);
+							return 1;
+						}
+						break;
 					default:
 						printf("unknown optimization param %s\n", *argv);
 						return 2;
 				}
 				break;
+			case 'M':
+				switch (*++(*argv)) {
+					case 'b':
+						_mstrat = 'b';
+						break;
+					case 'v':
+						_mstrat = 'v';
+						break;
+					default:
+						printf("unknown merge strategy %s\n", *argv);
+						return 2;
+				}
+				break;
+			case 't':
+				_timing = 1;
+				break;
+			case 'n':
+				_output = 0;
+				break;
+			case 'b':
+				_binary = 1;
+				break;
+			case 'j':
+				// either -j8 or -j 8
+				if (*++(*argv) == '\0' && argc > 1) {
+					--argc;
+					++argv;
+				}
+				_nthreads = atoi(*argv);
+				if (_nthreads <= 0) {
+					printf("number of threads must be a positive number.\n");
+					return 1;
+				}
+				break;
+			case 'B':
+				// either -B, -B1000000 or -B 1000000
+				_bench_len = BENCH_MAX_LEN;
+				if (*++(*argv) == '\0' && argc > 1 && argv[1][0] >= '0' && argv[1][0] <= '9') {
+					--argc;
+					++argv;
+				}
+				if (**argv >= '0' && **argv <= '9')
+					_bench_len = atol(*argv);
+				break;
+			case 'T':
+				// either -Tl or -T l
+				if (*++(*argv) == '\0' && argc > 1) {
+					--argc;
+					++argv;
+				}
+				_type = **argv;
+				break;
+			case 'F':
+				_bench_fmt = *++(*argv);
+				if (_bench_fmt != 'c' && _bench_fmt != 'j') {
+					printf("unknown output format %s\n", *argv);
+					return 1;
+				}
+				break;
+			case 'm':
+				// either -m64 or -m 64
+				if (*++(*argv) == '\0' && argc > 1) {
+					--argc;
+					++argv;
+				}
+				_ext_mem = atol(*argv);
+				if (_ext_mem <= 0) {
+					printf("memory budget must be a positive number.\n");
+					return 1;
+				}
+				break;
 			default: 
 				printf("unknown option %s\n", *argv);
 				return 1;
 		}
 	}
 
-	int *arr = (int *)malloc(MAX_ARR_LEN * sizeof(int));
+	struct timeval t1, t2;
+	double elapsed;
+
+	if (_bench_len > 0)
+		return _bench(_bench_len, _bench_fmt);
+	if (_type != 'i')
+		return _sort_typed(_type);
+
+	if (_opt == 'e') {
+		gettimeofday(&t1, NULL);
+		_sort_external(_ext_mem << 20);
+		gettimeofday(&t2, NULL);
+
+		if (_timing) {
+			elapsed = (t2.tv_sec - t1.tv_sec) * 1000.0;     // sec to ms
+			elapsed += (t2.tv_usec - t1.tv_usec) / 1000.0;  // us to ms
+			fprintf(stderr, "read, sorted and printed in %fms\n", elapsed);
+		}
+		return 0;
+	}
+
+	int *arr;
 	int i = 0;
 	int num;
+	long cnt;
+	struct _kernel *k;
 
-	// read an array from stdin
-	while ((num = _getnum()) != EOF && i < MAX_ARR_LEN) {
-		arr[i++] = num;
+	// read an array from stdin, a binary file is used in place
+	gettimeofday(&t1, NULL);
+	arr = _readbin(&cnt);
+	if (arr != NULL) {
+		if (cnt > INT_MAX) {
+			printf("binary input of %ld numbers is too big, use -Oe\n", cnt);
+			return 1;
+		}
+		i = (int)cnt;
+	} else {
+		arr = (int *)malloc(MAX_ARR_LEN * sizeof(int));
+		i = _readnums(arr, MAX_ARR_LEN);
+	}
+	gettimeofday(&t2, NULL);
+
+	if (_timing) {
+		elapsed = (t2.tv_sec - t1.tv_sec) * 1000.0;     // sec to ms
+		elapsed += (t2.tv_usec - t1.tv_usec) / 1000.0;  // us to ms
+		fprintf(stderr, "read %d numbers (%ld bytes) in %fms, %f GB/s\n", i, _rd_consumed(), 
+			elapsed, _rd_consumed() / elapsed / 1e6);
+	}
+	if (i == MAX_ARR_LEN && _readnum(&num)) {
+		fprintf(stderr, "warning: only the first %d numbers are sorted, use -Oe for bigger inputs\n", 
+			MAX_ARR_LEN);
 	}
 
 	// sort the array using merge sort algorithm
-	switch (_opt) {
-		case 's': 
-			_sort_merge_s(arr, 0, i - 1);
-			break;
-		case 'i':
-			_sort_merge_i(arr, 0, i - 1);
-			break;
-		default:
-			_sort_merge(arr, 0, i - 1);
-	}	
+	gettimeofday(&t1, NULL);
+	for (k = _kernels; k->name != NULL && k->opt != _opt; k++);
+	if (k->name == NULL) {
+		printf("unknown optimization param %c\n", _opt);
+		return 2;
+	}
+	k->sort(arr, i);
+
+	gettimeofday(&t2, NULL);
+
+	if (_timing) {
+		elapsed = (t2.tv_sec - t1.tv_sec) * 1000.0;     // sec to ms
+		elapsed += (t2.tv_usec - t1.tv_usec) / 1000.0;  // us to ms
+		fprintf(stderr, "sorted %d numbers in %fms\n", i, elapsed);
+	}
 
 	// print the result
-	int n = i;
-	for (i = 0; i < n; i++) {
-		printf("%d\n", arr[i]);
+	if (_output && _binary) {
+		_writebin_hdr(i);
+		_writeraws(arr, i);
+	} else if (_output) {
+		_writenums(arr, i);
+		_wr_flush();
+	}
+
+	return 0;
+}
+
+/* sorts the whole input of the element type t with the merge sort of sort_kernels.h,
+   or its radix sort with -Or, and prints it the same way */
+int _sort_typed(char t) {
+	struct _ktype *y;
+	struct timeval t1, t2;
+	double elapsed;
+	void *arr;
+	long n;
+	int owned;
+
+	for (y = _ktypes; y->opt != 0 && y->opt != t; y++);
+	if (y->opt == 0) {
+		printf("unknown element type %c\n", t);
+		return 1;
+	}
+	if (_opt != '0' && _opt != 'i' && _opt != 'b' && _opt != 'r') {
+		printf("-T sorts with the merge sort, or the radix sort with -Or\n");
+		return 1;
+	}
+
+	gettimeofday(&t1, NULL);
+	arr = _readall_typed(y->bin, &n, &owned);
+	gettimeofday(&t2, NULL);
+	if (_timing) {
+		elapsed = (t2.tv_sec - t1.tv_sec) * 1000.0;     // sec to ms
+		elapsed += (t2.tv_usec - t1.tv_usec) / 1000.0;  // us to ms
+		fprintf(stderr, "read %ld numbers of type %c in %fms\n", n, t, elapsed);
+	}
+
+	gettimeofday(&t1, NULL);
+	if (_opt == 'r')
+		y->radix(arr, n);
+	else
+		y->merge(arr, n);
+	gettimeofday(&t2, NULL);
+
+	if (_timing) {
+		elapsed = (t2.tv_sec - t1.tv_sec) * 1000.0;     // sec to ms
+		elapsed += (t2.tv_usec - t1.tv_usec) / 1000.0;  // us to ms
+		fprintf(stderr, "sorted %ld numbers in %fms\n", n, elapsed);
+	}
+
+	if (_output && _binary) {
+		_writebin_typed_hdr(n, y->bin);
+		_writebuf(arr, n * _bin_size(y->bin));
+	} else if (_output) {
+		_writetyped(arr, n, y->bin);
+		_wr_flush();
 	}
+	if (owned)
+		free(arr);
 
 	return 0;
 }
@@ -110,6 +587,13 @@ void _merge(int *a, int p, int q, int r) {
 		ra[j] = a[k++];
 	}
 
+	if (_mstrat != '0') {
+		_merge_kernel(la, n1, ra, n2, a + p);
+		free((void *)la);
+		free((void *)ra);
+		return;
+	}
+
 	// merge
 	k = p;
 	i = 0;
@@ -155,8 +639,8 @@ void _merge_s(int *a, int p, int q, int r) {
 	// copy left and right parts of the array
 	n1 = q - p + 1;
 	n2 = r - q;
-	la = (int *)malloc((n1 + 1) * sizeof(int));
-	ra = (int *)malloc((n2 + 1) * sizeof(int));
+	la = (int *)malloc(n1 * sizeof(int));
+	ra = (int *)malloc(n2 * sizeof(int));
 	k = p;
 	for (i = 0; i < n1; i++) {
 		la[i] = a[k++];
@@ -165,18 +649,39 @@ void _merge_s(int *a, int p, int q, int r) {
 		ra[j] = a[k++];
 	}
 
-	// add sentinel elements to the end
-	la[n1] = INF;
-	ra[n2] = INF;
+	if (_mstrat != '0') {
+		_merge_kernel(la, n1, ra, n2, a + p);
+		free((void *)la);
+		free((void *)ra);
+		return;
+	}
 
-	// merge
+	// the part with the smaller last number runs out first, the last number of
+	// the other part stops the merge as a sentinel would (an INF sentinel is
+	// wrong for inputs with INT_MAX), then the rest of the other part is copied
 	k = p;
 	i = 0;
 	j = 0;
-	while (k <= r) {
-		if (la[i] < ra[j]) {
+	if (a[r] <= a[q]) {
+		while (j < n2) {
+			if (la[i] < ra[j]) {
+				a[k++] = la[i++];
+			} else {
+				a[k++] = ra[j++];
+			}
+		}
+		while (i < n1) {
 			a[k++] = la[i++];
-		} else {
+		}
+	} else {
+		while (i < n1) {
+			if (la[i] < ra[j]) {
+				a[k++] = la[i++];
+			} else {
+				a[k++] = ra[j++];
+			}
+		}
+		while (j < n2) {
 			a[k++] = ra[j++];
 		}
 	}
@@ -200,9 +705,9 @@ void _sort_merge_i(int *a, int p, int r) {
 	if (p >= r)
 		return;
 
-	if (r - p + 1 <= INSERT_SORT_LEN) {
+	if (r - p + 1 <= _insert_len) {
 		// utilizing the insertion sort algorithm for smaller sub-arrays
-		_sort_insert(a, p, r);
+		_sort_net(a, p, r);
 		return;
 	}
 
@@ -212,26 +717,2244 @@ void _sort_merge_i(int *a, int p, int r) {
 	_merge_s(a, p, q, r);
 }
 
-char _buf[MAX_BUF_LEN];
-int _getnum() {
-	int c;
-	char *ptr = _buf;
+/* sorts a[p..r] of up to NET_SORT_LEN numbers with a sorting network,
+   falls back to the insertion sort without AVX2 */
+void _sort_net(int *a, int p, int r) {
+	int n = r - p + 1;
+
+	if (!_avx2 || n < 2 || n > NET_SORT_LEN) {
+		_sort_insert(a, p, r);
+		return;
+	}
+	_sort_net_pad(a + p, n);
+}
+
+/* merges la[0..n1-1] and ra[0..n2-1] into out with the selected merge strategy */
+void _merge_kernel(int *la, int n1, int *ra, int n2, int *out) {
+	if (_mstrat == 'v' && _avx2) {
+		_merge_avx2(la, n1, ra, n2, out);
+	} else {
+		_merge_nb(la, n1, ra, n2, out);
+	}
+}
+
+/* branchless merge, the comparison result moves the indexes instead of a jump */
+void _merge_nb(int *la, int n1, int *ra, int n2, int *out) {
+	int i, j, k, x, y, t;
+
+	i = 0;
+	j = 0;
+	k = 0;
+	while (i < n1 && j < n2) {
+		x = la[i];
+		y = ra[j];
+		t = y < x;
+		out[k++] = t ? y : x;
+		i += 1 - t;
+		j += t;
+	}
+
+	// copy tails
+	memcpy((void *)(out + k), (void *)(la + i), (n1 - i) * sizeof(int));
+	k += n1 - i;
+	memcpy((void *)(out + k), (void *)(ra + j), (n2 - j) * sizeof(int));
+}
+
+/* merges by blocks of 8: the vector with the 8 largest numbers seen so far is
+   merged with the next block of the input whose next number is smaller, the lower
+   half of the bitonic merge goes to the output */
+__attribute__((target("avx2")))
+void _merge_avx2(int *la, int n1, int *ra, int n2, int *out) {
+	__m256i rev, a, b, lo, hi;
+	int buf[8], t[16];
+	int *sa, *sb;
+	int i, j, k, na, nb;
+
+	if (n1 < 8 || n2 < 8) {
+		_merge_nb(la, n1, ra, n2, out);
+		return;
+	}
+
+	rev = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+	a = _mm256_loadu_si256((__m256i *)la);
+	i = 8;
+	j = 0;
+	k = 0;
+	while (j + 8 <= n2) {
+		b = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((__m256i *)(ra + j)), rev);
+		j += 8;
+		for (;;) {
+			lo = _clean8(_mm256_min_epi32(a, b));
+			hi = _clean8(_mm256_max_epi32(a, b));
+			_mm256_storeu_si256((__m256i *)(out + k), lo);
+			k += 8;
+			a = hi;
+
+			// take the next block from the left while it starts lower
+			if (i + 8 > n1 || (j < n2 && ra[j] < la[i]))
+				break;
+			b = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((__m256i *)(la + i)), rev);
+			i += 8;
+		}
+		if (i + 8 > n1)
+			break;
+	}
+
+	// the 8 numbers left in the register and the tails are merged by scalar code,
+	// first with the shorter tail into a small buffer
+	_mm256_storeu_si256((__m256i *)buf, a);
+	if (n1 - i < 8) {
+		sa = la + i;
+		na = n1 - i;
+		sb = ra + j;
+		nb = n2 - j;
+	} else {
+		sa = ra + j;
+		na = n2 - j;
+		sb = la + i;
+		nb = n1 - i;
+	}
+	_merge_nb(buf, 8, sa, na, t);
+	_merge_nb(t, 8 + na, sb, nb, out + k);
+}
+
+void _sort_merge_b(int *a, int n) {
+	int *src, *dst, *tmp;
+	int w, p, q, r;
+
+	// sort small blocks in place first, the passes below start from them
+	for (p = 0; p < n; p += _insert_len) {
+		r = p + _insert_len - 1;
+		_sort_net(a, p, r < n ? r : n - 1);
+	}
+	if (n <= _insert_len)
+		return;
+
+	// the only allocation of the whole sort
+	src = a;
+	dst = (int *)malloc(n * sizeof(int));
+
+	for (w = _insert_len; w < n; w *= 2) {
+		for (p = 0; p < n; p += 2 * w) {
+			q = p + w - 1;
+			r = p + 2 * w - 1;
+			if (q >= n - 1) {
+				// a lonely left run, just carry it over to the other side
+				memcpy((void *)(dst + p), (void *)(src + p), (n - p) * sizeof(int));
+				continue;
+			}
+			_merge_b(src, dst, p, q, r < n ? r : n - 1);
+		}
+
+		// swap roles instead of copying back
+		tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+
+	// the result may end up in the scratch buffer after an odd number of passes
+	if (src != a) {
+		memcpy((void *)a, (void *)src, n * sizeof(int));
+		free((void *)src);
+	} else {
+		free((void *)dst);
+	}
+}
+
+/* merges src[p..q] and src[q+1..r] into dst[p..r] */
+void _merge_b(int *src, int *dst, int p, int q, int r) {
+	int i, j, k;
+
+	if (_mstrat != '0') {
+		_merge_kernel(src + p, q - p + 1, src + q + 1, r - q, dst + p);
+		return;
+	}
+
+	i = p;
+	j = q + 1;
+	k = p;
+	while (i <= q && j <= r) {
+		if (src[j] < src[i]) {
+			dst[k++] = src[j++];
+		} else {
+			dst[k++] = src[i++];
+		}
+	}
+
+	// copy tails
+	while (i <= q) {
+		dst[k++] = src[i++];
+	}
+	while (j <= r) {
+		dst[k++] = src[j++];
+	}
+}
+
+/* natural merge sort: finds ascending and descending runs, extends the short ones to
+   minrun with the small sub-array sort, and merges them in the powersort order */
+void _sort_merge_a(int *a, int n) {
+	int st[RUN_STACK_LEN], ln[RUN_STACK_LEN], pw[RUN_STACK_LEN];
+	int *tmp;
+	int minrun, top, s1, n1, s2, n2, p, m, c;
+
+	if (n < 2)
+		return;
+
+	// minrun between _insert_len / 2 and _insert_len, so that n / minrun is
+	// close to a power of 2
+	c = 0;
+	for (m = n; m >= _insert_len; m >>= 1) {
+		c |= m & 1;
+	}
+	minrun = m + c;
+
+	tmp = (int *)malloc(n * sizeof(int));
+	top = 0;
+	s1 = 0;
+	n1 = _find_run(a, s1, n, minrun);
+	while (s1 + n1 < n) {
+		s2 = s1 + n1;
+		n2 = _find_run(a, s2, n, minrun);
+
+		// merge the runs on the stack that are deeper in the merge tree than the new node
+		p = _node_power(n, s1, n1, n2);
+		while (top > 0 && pw[top - 1] > p) {
+			top--;
+			_merge_a(a, st[top], ln[top], n1, tmp);
+			s1 = st[top];
+			n1 += ln[top];
+		}
+
+		st[top] = s1;
+		ln[top] = n1;
+		pw[top] = p;
+		top++;
+		s1 = s2;
+		n1 = n2;
+	}
+	while (top > 0) {
+		top--;
+		_merge_a(a, st[top], ln[top], n1, tmp);
+		n1 += ln[top];
+	}
+
+	free((void *)tmp);
+}
+
+/* returns the length of a run starting at a[lo], a descending run is reversed,
+   a run shorter than minrun is extended with the small sub-array sort */
+int _find_run(int *a, int lo, int n, int minrun) {
+	int hi, i, j, k;
+
+	hi = lo + 1;
+	if (hi == n)
+		return 1;
+
+	if (a[hi] < a[lo]) {
+		// strictly descending, so that reversing keeps equal numbers in order
+		while (hi + 1 < n && a[hi + 1] < a[hi])
+			hi++;
+		for (i = lo, j = hi; i < j; i++, j--) {
+			k = a[i];
+			a[i] = a[j];
+			a[j] = k;
+		}
+	} else {
+		while (hi + 1 < n && a[hi + 1] >= a[hi])
+			hi++;
+	}
+
+	if (hi - lo + 1 < minrun) {
+		hi = lo + minrun - 1 < n - 1 ? lo + minrun - 1 : n - 1;
+		_sort_net(a, lo, hi);
+	}
+
+	return hi - lo + 1;
+}
+
+/* depth of the boundary between runs a[s1..s1+n1-1] and a[s1+n1..s1+n1+n2-1]
+   in the nearly optimal merge tree (powersort) */
+int _node_power(int n, int s1, int n1, int n2) {
+	long l, r;
+	int p;
+
+	// the doubled midpoints of the two runs, the power is the first bit they differ in
+	l = 2L * s1 + n1;
+	r = l + n1 + n2;
+	p = 0;
+	for (;;) {
+		p++;
+		if (l >= n) {
+			l -= n;
+			r -= n;
+		} else if (r >= n) {
+			break;
+		}
+		l <<= 1;
+		r <<= 1;
+	}
+
+	return p;
+}
+
+/* merges a[s1..s1+n1-1] and the run right after it, galloping through the inputs
+   when one of them wins MIN_GALLOP times in a row */
+void _merge_a(int *a, int s1, int n1, int n2, int *tmp) {
+	int *pa, *pb, *dest;
+	int k, ca, cb;
+
+	// the beginning of the left run and the end of the right run are in place already
+	k = _gallop_right(a[s1 + n1], a + s1, n1);
+	s1 += k;
+	n1 -= k;
+	if (n1 == 0)
+		return;
+	n2 = _gallop_left(a[s1 + n1 - 1], a + s1 + n1, n2);
+
+	memcpy((void *)tmp, (void *)(a + s1), n1 * sizeof(int));
+	pa = tmp;
+	pb = a + s1 + n1;
+	dest = a + s1;
+	while (n1 > 0 && n2 > 0) {
+		// one at a time
+		ca = 0;
+		cb = 0;
+		while (n1 > 0 && n2 > 0 && ca < MIN_GALLOP && cb < MIN_GALLOP) {
+			if (*pb < *pa) {
+				*dest++ = *pb++;
+				n2--;
+				cb++;
+				ca = 0;
+			} else {
+				*dest++ = *pa++;
+				n1--;
+				ca++;
+				cb = 0;
+			}
+		}
+
+		// galloping while it copies long enough chunks
+		do {
+			if (n1 == 0 || n2 == 0)
+				break;
+			ca = _gallop_right(*pb, pa, n1);
+			memcpy((void *)dest, (void *)pa, ca * sizeof(int));
+			dest += ca;
+			pa += ca;
+			n1 -= ca;
+			if (n1 == 0)
+				break;
+			*dest++ = *pb++;
+			n2--;
+			if (n2 == 0)
+				break;
+			cb = _gallop_left(*pa, pb, n2);
+			memmove((void *)dest, (void *)pb, cb * sizeof(int));
+			dest += cb;
+			pb += cb;
+			n2 -= cb;
+			if (n2 == 0)
+				break;
+			*dest++ = *pa++;
+			n1--;
+		} while (ca >= MIN_GALLOP || cb >= MIN_GALLOP);
+	}
+
+	// the rest of the right run is in place
+	memcpy((void *)dest, (void *)pa, n1 * sizeof(int));
+}
+
+/* number of elements of a sorted b[0..n-1] that are <= key, exponential search */
+int _gallop_right(int key, int *b, int n) {
+	int last, ofs, m;
+
+	if (n == 0 || b[0] > key)
+		return 0;
+
+	last = 0;
+	ofs = 1;
+	while (ofs < n && b[ofs] <= key) {
+		last = ofs;
+		ofs = 2 * ofs + 1;
+	}
+	if (ofs > n)
+		ofs = n;
+
+	// b[last] <= key < b[ofs]
+	last++;
+	while (last < ofs) {
+		m = last + (ofs - last) / 2;
+		if (b[m] <= key) {
+			last = m + 1;
+		} else {
+			ofs = m;
+		}
+	}
+
+	return last;
+}
+
+/* number of elements of a sorted b[0..n-1] that are < key, exponential search */
+int _gallop_left(int key, int *b, int n) {
+	int last, ofs, m;
+
+	if (n == 0 || b[0] >= key)
+		return 0;
+
+	last = 0;
+	ofs = 1;
+	while (ofs < n && b[ofs] < key) {
+		last = ofs;
+		ofs = 2 * ofs + 1;
+	}
+	if (ofs > n)
+		ofs = n;
+
+	// b[last] < key <= b[ofs]
+	last++;
+	while (last < ofs) {
+		m = last + (ofs - last) / 2;
+		if (b[m] < key) {
+			last = m + 1;
+		} else {
+			ofs = m;
+		}
+	}
+
+	return last;
+}
+
+/* external merge sort: sorts chunks of the input that fit into the memory budget,
+   spills them as binary sorted runs to temp files and merges up to fan-in runs at a
+   time through a loser tree, the last pass prints the result */
+void _sort_external(long budget) {
+	struct _erun *runs, *in;
+	FILE **files, **next;
+	int *arr, *out;
+	long n, total, chunk;
+	int nruns, nnext, fanin, bufsize, passes, i, j, k;
+
+	chunk = budget / (2 * sizeof(int)); // half for the scratch buffer of -Ob
+	if (chunk > EXT_MAX_CHUNK)
+		chunk = EXT_MAX_CHUNK;
+	arr = (int *)malloc(chunk * sizeof(int));
+	if (arr == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+
+	// form the sorted runs
+	files = NULL;
+	nruns = 0;
+	total = 0;
+	passes = 1;
+	do {
+		n = _readnums(arr, (int)chunk);
+		total += n;
+		_sort_merge_b(arr, (int)n);
+
+		if (nruns == 0 && n < chunk) {
+			// everything fits into the memory
+			if (_output && _binary) {
+				_writebin_hdr(n);
+				_writeraws(arr, n);
+			} else if (_output) {
+				_writenums(arr, (int)n);
+				_wr_flush();
+			}
+			free((void *)arr);
+			if (_timing)
+				fprintf(stderr, "external sort: %ld numbers, 1 run, 1 pass, 0 bytes of I/O\n", total);
+			return;
+		}
+		if (n == 0)
+			break;
+
+		files = (FILE **)realloc(files, (nruns + 1) * sizeof(FILE *));
+		files[nruns] = tmpfile();
+		if (files[nruns] == NULL) {
+			perror("tmpfile");
+			exit(1);
+		}
+		if (fwrite((void *)arr, sizeof(int), n, files[nruns]) != (size_t)n
+				|| fflush(files[nruns]) != 0) {
+			perror("tmpfile write");
+			exit(1);
+		}
+		rewind(files[nruns]);
+		_ext_written += n * sizeof(int);
+		nruns++;
+	} while (n == chunk);
+	free((void *)arr);
+
+	// every run being merged and the output get a buffer of the same size
+	fanin = (int)(budget / EXT_MIN_BUF_LEN) - 1;
+	if (fanin > EXT_MAX_FANIN)
+		fanin = EXT_MAX_FANIN;
+	if (fanin < 2)
+		fanin = 2;
+	n = budget / (fanin + 1) / sizeof(int);
+	bufsize = (int)(n < chunk ? n : chunk);
+	runs = (struct _erun *)malloc(fanin * sizeof(struct _erun));
+	for (i = 0; i < fanin; i++) {
+		runs[i].buf = (int *)malloc(bufsize * sizeof(int));
+		if (runs[i].buf == NULL) {
+			perror("malloc");
+			exit(1);
+		}
+	}
+	out = (int *)malloc(bufsize * sizeof(int));
+	if (out == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+
+	// intermediate passes, until the runs can be merged at once
+	while (nruns > fanin) {
+		passes++;
+		nnext = (nruns + fanin - 1) / fanin;
+		next = (FILE **)malloc(nnext * sizeof(FILE *));
+		for (j = 0; j < nnext; j++) {
+			k = nruns - j * fanin < fanin ? nruns - j * fanin : fanin;
+			in = runs;
+			for (i = 0; i < k; i++) {
+				in[i].f = files[j * fanin + i];
+				in[i].len = 0;
+				in[i].pos = 0;
+			}
+			next[j] = tmpfile();
+			if (next[j] == NULL) {
+				perror("tmpfile");
+				exit(1);
+			}
+			_merge_runs(in, k, out, bufsize, next[j]);
+			if (fflush(next[j]) != 0) {
+				perror("tmpfile write");
+				exit(1);
+			}
+			rewind(next[j]);
+			for (i = 0; i < k; i++) {
+				fclose(in[i].f);
+			}
+		}
+		free((void *)files);
+		files = next;
+		nruns = nnext;
+	}
+
+	// the last pass
+	passes++;
+	if (_output && _binary)
+		_writebin_hdr(total);
+	for (i = 0; i < nruns; i++) {
+		runs[i].f = files[i];
+		runs[i].len = 0;
+		runs[i].pos = 0;
+	}
+	_merge_runs(runs, nruns, out, bufsize, NULL);
+	for (i = 0; i < nruns; i++) {
+		fclose(runs[i].f);
+	}
+
+	if (_timing)
+		fprintf(stderr, "external sort: %ld numbers, %d runs, %d passes, %ld bytes written, %ld bytes read\n",
+			total, (int)((total + chunk - 1) / chunk), passes, _ext_written, _ext_read);
+
+	for (i = 0; i < fanin; i++) {
+		free((void *)runs[i].buf);
+	}
+	free((void *)runs);
+	free((void *)out);
+	free((void *)files);
+}
+
+/* merges k runs through a loser tree into the file f, or prints them to stdout
+   when f is NULL */
+void _merge_runs(struct _erun *runs, int k, int *out, int bufsize, FILE *f) {
+	int *tree;
+	int i, n, w, s, t;
+
+	for (i = 0; i < k; i++) {
+		_run_fill(runs + i, bufsize);
+	}
+
+	// tree[0] is the winner, tree[1..k-1] are the losers of the internal nodes,
+	// the runs are the leaves k..2k-1
+	tree = (int *)malloc((k > 1 ? k : 2) * sizeof(int));
+	tree[0] = k > 1 ? _lt_build(runs, tree, k, 1) : 0;
 
-	// skip spaces until we get a start of a new number
-	for (c = getchar(); c == '\n' || c == ' '; c = getchar());
+	n = 0;
+	while (runs[w = tree[0]].len > 0) {
+		out[n++] = runs[w].buf[runs[w].pos++];
+		if (n == bufsize) {
+			_run_flush(out, n, f);
+			n = 0;
+		}
+		if (runs[w].pos == runs[w].len)
+			_run_fill(runs + w, bufsize);
 
-	// read chars of a number
-	while (c != EOF && c != '\n' && c != ' ' 
-		&& ptr < _buf + MAX_BUF_LEN - 1) {
-		*ptr++ = c;
-		c = getchar();
+		// replay the matches on the path from the winner's leaf to the root
+		s = w;
+		for (t = (w + k) / 2; t > 0; t /= 2) {
+			if (_lt_less(runs, tree[t], s)) {
+				i = tree[t];
+				tree[t] = s;
+				s = i;
+			}
+		}
+		tree[0] = s;
 	}
+	_run_flush(out, n, f);
+
+	free((void *)tree);
+}
+
+/* plays the matches of the subtree at node, stores the losers and returns the winner */
+int _lt_build(struct _erun *runs, int *tree, int k, int node) {
+	int w1, w2;
 
-	*ptr = '\0';
+	if (node >= k)
+		return node - k;
 
-	if (ptr == _buf && c == EOF) {
-		return EOF;
+	w1 = _lt_build(runs, tree, k, 2 * node);
+	w2 = _lt_build(runs, tree, k, 2 * node + 1);
+	if (_lt_less(runs, w2, w1)) {
+		tree[node] = w1;
+		return w2;
 	}
+	tree[node] = w2;
+	return w1;
+}
 
-	return atoi(_buf);
-}
\ No newline at end of file
+/* a run that is over loses to any other run */
+int _lt_less(struct _erun *runs, int x, int y) {
+	if (runs[x].len == 0)
+		return 0;
+	if (runs[y].len == 0)
+		return 1;
+	return runs[x].buf[runs[x].pos] < runs[y].buf[runs[y].pos];
+}
+
+void _run_fill(struct _erun *run, int bufsize) {
+	run->len = (int)fread((void *)run->buf, sizeof(int), bufsize, run->f);
+	if (ferror(run->f)) {
+		perror("tmpfile read");
+		exit(1);
+	}
+	run->pos = 0;
+	_ext_read += run->len * sizeof(int);
+}
+
+void _run_flush(int *out, int n, FILE *f) {
+	if (f == NULL) {
+		if (_output && _binary) {
+			_writeraws(out, n);
+		} else if (_output) {
+			_writenums(out, n);
+			_wr_flush();
+		}
+		return;
+	}
+	if (fwrite((void *)out, sizeof(int), n, f) != (size_t)n) {
+		perror("tmpfile write");
+		exit(1);
+	}
+	_ext_written += n * sizeof(int);
+}
+
+pthread_mutex_t _pool_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t _pool_cond = PTHREAD_COND_INITIALIZER;
+struct _ptask *_pool_head = NULL;	// pending tasks, the last pushed runs first
+pthread_t *_pool_threads;
+int _pool_size = 0;
+int _pool_stopped = 0;
+
+void _sort_merge_p(int *a, int n) {
+	if (_nthreads <= 0) {
+		_nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if (_nthreads <= 0)
+			_nthreads = 1;
+	}
+	if (_nthreads == 1 || n <= PARALLEL_LEN) {
+		_sort_merge_i(a, 0, n - 1);
+		return;
+	}
+
+	int *tmp = (int *)malloc(n * sizeof(int));
+
+	// the calling thread takes part in the work too
+	_pool_start(_nthreads - 1);
+	_psort(a, tmp, 0, n - 1);
+	_pool_stop();
+
+	free((void *)tmp);
+}
+
+/* fork the left half to the pool, sort the right half, join and merge */
+void _psort(int *a, int *tmp, int p, int r) {
+	if (r - p + 1 <= PARALLEL_LEN) {
+		_sort_merge_i(a, p, r);
+		return;
+	}
+
+	int q = (p + r) / 2; // greatest int <= q
+	struct _ptask left = { 's', a, tmp, p, q, q, 0, 0, 0, NULL, NULL };
+
+	_pool_push(&left);
+	_psort(a, tmp, q + 1, r);
+	_pool_join(&left);
+	_pmerge(a, tmp, p, q, r);
+}
+
+/* merges a[p..q] and a[q+1..r] splitting the output into segments (merge path),
+   every segment is merged into tmp by its own task and then copied back */
+void _pmerge(int *a, int *tmp, int p, int q, int r) {
+	int n = r - p + 1;
+	int segs = n / PARALLEL_LEN;
+	int s;
+
+	if (segs > _nthreads)
+		segs = _nthreads;
+	if (segs <= 1) {
+		_merge_b(a, tmp, p, q, r);
+		memcpy((void *)(a + p), (void *)(tmp + p), n * sizeof(int));
+		return;
+	}
+
+	struct _ptask *t = (struct _ptask *)malloc(segs * sizeof(struct _ptask));
+	for (s = 0; s < segs; s++) {
+		t[s].kind = 'm';
+		t[s].a = a;
+		t[s].tmp = tmp;
+		t[s].p = p;
+		t[s].q = q;
+		t[s].r = r;
+		t[s].k1 = (int)((long)n * s / segs);
+		t[s].k2 = (int)((long)n * (s + 1) / segs);
+	}
+
+	// merge all the segments before any of them is copied back over the input
+	for (s = 1; s < segs; s++)
+		_pool_push(t + s);
+	_pool_run(t);
+	for (s = 1; s < segs; s++)
+		_pool_join(t + s);
+
+	for (s = 0; s < segs; s++)
+		t[s].kind = 'c';
+	for (s = 1; s < segs; s++)
+		_pool_push(t + s);
+	_pool_run(t);
+	for (s = 1; s < segs; s++)
+		_pool_join(t + s);
+
+	free((void *)t);
+}
+
+/* number of elements of a[0..m-1] among the first k elements of
+   the stable merge of a[0..m-1] and b[0..n-1] */
+int _corank(int k, int *a, int m, int *b, int n) {
+	int lo, hi, i, j;
+
+	lo = k > n ? k - n : 0;
+	hi = k < m ? k : m;
+	for (;;) {
+		i = (lo + hi) / 2;
+		j = k - i;
+		if (i < m && j > 0 && a[i] <= b[j - 1]) {
+			lo = i + 1;		// a[i] goes before b[j - 1], take more from a
+		} else if (i > 0 && j < n && a[i - 1] > b[j]) {
+			hi = i - 1;		// b[j] goes before a[i - 1], take less from a
+		} else {
+			return i;
+		}
+	}
+}
+
+void _pool_run(struct _ptask *t) {
+	int *la, *ra;
+	int n1, n2, i, j, k, i2, j2;
+
+	switch (t->kind) {
+		case 's':
+			_psort(t->a, t->tmp, t->p, t->r);
+			break;
+		case 'm':
+			la = t->a + t->p;
+			ra = t->a + t->q + 1;
+			n1 = t->q - t->p + 1;
+			n2 = t->r - t->q;
+			i = _corank(t->k1, la, n1, ra, n2);
+			j = t->k1 - i;
+			i2 = _corank(t->k2, la, n1, ra, n2);
+			j2 = t->k2 - i2;
+			k = t->p + t->k1;
+			if (_mstrat != '0') {
+				_merge_kernel(la + i, i2 - i, ra + j, j2 - j, t->tmp + k);
+				break;
+			}
+			while (i < i2 && j < j2) {
+				if (ra[j] < la[i]) {
+					t->tmp[k++] = ra[j++];
+				} else {
+					t->tmp[k++] = la[i++];
+				}
+			}
+			while (i < i2) {
+				t->tmp[k++] = la[i++];
+			}
+			while (j < j2) {
+				t->tmp[k++] = ra[j++];
+			}
+			break;
+		case 'c':
+			memcpy((void *)(t->a + t->p + t->k1), (void *)(t->tmp + t->p + t->k1),
+				(t->k2 - t->k1) * sizeof(int));
+			break;
+		case 'h':
+			memset((void *)t->cnt, 0, RADIX_SIZE * sizeof(unsigned));
+			for (i = t->p; i <= t->r; i++) {
+				t->cnt[RADIX_DIGIT(t->a[i], t->q)]++;
+			}
+			break;
+		case 'x':
+			for (i = t->p; i <= t->r; i++) {
+				t->tmp[t->cnt[RADIX_DIGIT(t->a[i], t->q)]++] = t->a[i];
+			}
+			break;
+		case 'g':
+			memset((void *)t->cnt, 0, 2 * SAMPLE_BUCKETS * sizeof(unsigned));
+			_sample_pass(t->a, t->p, t->r, t->cnt, NULL);
+			break;
+		case 'd':
+			_sample_pass(t->a, t->p, t->r, t->cnt, t->tmp);
+			break;
+		case 'u':
+			_sort_pdq(t->tmp + t->p, t->r - t->p + 1);
+			memcpy((void *)(t->a + t->p), (void *)(t->tmp + t->p), (t->r - t->p + 1) * sizeof(int));
+			break;
+	}
+}
+
+void _pool_start(int n) {
+	int i;
+
+	_pool_stopped = 0;
+	_pool_size = n;
+	_pool_threads = (pthread_t *)malloc(n * sizeof(pthread_t));
+	for (i = 0; i < n; i++) {
+		pthread_create(_pool_threads + i, NULL, _pool_worker, NULL);
+	}
+}
+
+void _pool_stop() {
+	int i;
+
+	pthread_mutex_lock(&_pool_lock);
+	_pool_stopped = 1;
+	pthread_cond_broadcast(&_pool_cond);
+	pthread_mutex_unlock(&_pool_lock);
+
+	for (i = 0; i < _pool_size; i++) {
+		pthread_join(_pool_threads[i], NULL);
+	}
+	free((void *)_pool_threads);
+}
+
+void _pool_push(struct _ptask *t) {
+	pthread_mutex_lock(&_pool_lock);
+	t->done = 0;
+	t->next = _pool_head;
+	_pool_head = t;
+	pthread_cond_broadcast(&_pool_cond);
+	pthread_mutex_unlock(&_pool_lock);
+}
+
+/* waits for a task to finish, running pending tasks in the meantime */
+void _pool_join(struct _ptask *t) {
+	struct _ptask *w;
+
+	pthread_mutex_lock(&_pool_lock);
+	while (!t->done) {
+		if (_pool_head == NULL) {
+			pthread_cond_wait(&_pool_cond, &_pool_lock);
+			continue;
+		}
+		w = _pool_head;
+		_pool_head = w->next;
+		pthread_mutex_unlock(&_pool_lock);
+
+		_pool_run(w);
+
+		pthread_mutex_lock(&_pool_lock);
+		w->done = 1;
+		pthread_cond_broadcast(&_pool_cond);
+	}
+	pthread_mutex_unlock(&_pool_lock);
+}
+
+void *_pool_worker(void *arg) {
+	struct _ptask *w;
+
+	(void)arg;
+	pthread_mutex_lock(&_pool_lock);
+	while (!_pool_stopped) {
+		if (_pool_head == NULL) {
+			pthread_cond_wait(&_pool_cond, &_pool_lock);
+			continue;
+		}
+		w = _pool_head;
+		_pool_head = w->next;
+		pthread_mutex_unlock(&_pool_lock);
+
+		_pool_run(w);
+
+		pthread_mutex_lock(&_pool_lock);
+		w->done = 1;
+		pthread_cond_broadcast(&_pool_cond);
+	}
+	pthread_mutex_unlock(&_pool_lock);
+
+	return NULL;
+}
+
+void _sort_radix(int *a, int n) {
+	unsigned cnt[RADIX_PASSES][RADIX_SIZE];
+	unsigned sum, c;
+	int *src, *dst, *tmp;
+	int i, d, b;
+
+	if (n <= 1)
+		return;
+
+	tmp = (int *)malloc(n * sizeof(int));
+	if (_nthreads > 1) {
+		_sort_radix_p(a, tmp, n);
+		free((void *)tmp);
+		return;
+	}
+
+	// count all the digits in a single pass
+	memset((void *)cnt, 0, sizeof(cnt));
+	for (i = 0; i < n; i++) {
+		for (d = 0; d < RADIX_PASSES; d++) {
+			cnt[d][RADIX_DIGIT(a[i], d * RADIX_BITS)]++;
+		}
+	}
+
+	src = a;
+	dst = tmp;
+	for (d = 0; d < RADIX_PASSES; d++) {
+		// all the numbers have the same digit, the pass would not move anything
+		if (cnt[d][RADIX_DIGIT(a[0], d * RADIX_BITS)] == (unsigned)n)
+			continue;
+
+		// counts to the output positions
+		sum = 0;
+		for (b = 0; b < RADIX_SIZE; b++) {
+			c = cnt[d][b];
+			cnt[d][b] = sum;
+			sum += c;
+		}
+
+		for (i = 0; i < n; i++) {
+			dst[cnt[d][RADIX_DIGIT(src[i], d * RADIX_BITS)]++] = src[i];
+		}
+
+		// swap roles instead of copying back
+		a = src;
+		src = dst;
+		dst = a;
+	}
+
+	// after an odd number of passes the result is in the scratch buffer
+	if (src == tmp) {
+		memcpy((void *)dst, (void *)src, n * sizeof(int));
+		free((void *)src);
+	} else {
+		free((void *)dst);
+	}
+}
+
+/* every pass counts digits of _nthreads chunks in parallel, and every chunk
+   scatters its numbers to the output positions computed from all the counts */
+void _sort_radix_p(int *a, int *tmp, int n) {
+	struct _ptask *t;
+	unsigned *cnt;
+	unsigned sum, c;
+	int *src, *dst, *sw;
+	int nt, s, d, b;
+
+	nt = _nthreads;
+	if (nt > n / RADIX_SIZE)
+		nt = n / RADIX_SIZE > 0 ? n / RADIX_SIZE : 1;
+
+	t = (struct _ptask *)malloc(nt * sizeof(struct _ptask));
+	cnt = (unsigned *)malloc(nt * RADIX_SIZE * sizeof(unsigned));
+	for (s = 0; s < nt; s++) {
+		t[s].p = (int)((long)n * s / nt);
+		t[s].r = (int)((long)n * (s + 1) / nt) - 1;
+		t[s].cnt = cnt + s * RADIX_SIZE;
+	}
+
+	_pool_start(nt - 1);
+
+	src = a;
+	dst = tmp;
+	for (d = 0; d < RADIX_PASSES; d++) {
+		for (s = 0; s < nt; s++) {
+			t[s].kind = 'h';
+			t[s].a = src;
+			t[s].tmp = dst;
+			t[s].q = d * RADIX_BITS;
+		}
+		for (s = 1; s < nt; s++)
+			_pool_push(t + s);
+		_pool_run(t);
+		for (s = 1; s < nt; s++)
+			_pool_join(t + s);
+
+		// skip the pass if all the numbers have the same digit
+		b = RADIX_DIGIT(src[0], d * RADIX_BITS);
+		sum = 0;
+		for (s = 0; s < nt; s++)
+			sum += t[s].cnt[b];
+		if (sum == (unsigned)n)
+			continue;
+
+		// output positions, bucket by bucket, chunk by chunk within a bucket
+		sum = 0;
+		for (b = 0; b < RADIX_SIZE; b++) {
+			for (s = 0; s < nt; s++) {
+				c = t[s].cnt[b];
+				t[s].cnt[b] = sum;
+				sum += c;
+			}
+		}
+
+		for (s = 0; s < nt; s++)
+			t[s].kind = 'x';
+		for (s = 1; s < nt; s++)
+			_pool_push(t + s);
+		_pool_run(t);
+		for (s = 1; s < nt; s++)
+			_pool_join(t + s);
+
+		sw = src;
+		src = dst;
+		dst = sw;
+	}
+
+	_pool_stop();
+
+	if (src != a)
+		memcpy((void *)a, (void *)src, n * sizeof(int));
+
+	free((void *)cnt);
+	free((void *)t);
+}
+
+/* splits the array into 2 * SAMPLE_BUCKETS buckets, between the splitters and
+   equal to them, counting them in _nthreads chunks in parallel, scatters the chunks
+   to tmp, sorts the buckets in parallel and copies them back */
+void _sort_sample(int *a, int n) {
+	struct _ptask *t, *u;
+	unsigned *cnt;
+	unsigned sum, c;
+	int *tmp;
+	int nt, s, b, nb;
+
+	if (_nthreads <= 0) {
+		_nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if (_nthreads <= 0)
+			_nthreads = 1;
+	}
+	if (n <= PARALLEL_LEN) {
+		_sort_pdq(a, n);
+		return;
+	}
+
+	_sample_splitters(a, n);
+
+	nt = _nthreads;
+	tmp = (int *)malloc(n * sizeof(int));
+	t = (struct _ptask *)malloc(nt * sizeof(struct _ptask));
+	u = (struct _ptask *)malloc(2 * SAMPLE_BUCKETS * sizeof(struct _ptask));
+	cnt = (unsigned *)malloc(nt * 2 * SAMPLE_BUCKETS * sizeof(unsigned));
+	for (s = 0; s < nt; s++) {
+		t[s].kind = 'g';
+		t[s].a = a;
+		t[s].tmp = tmp;
+		t[s].p = (int)((long)n * s / nt);
+		t[s].r = (int)((long)n * (s + 1) / nt) - 1;
+		t[s].cnt = cnt + s * 2 * SAMPLE_BUCKETS;
+	}
+
+	_pool_start(nt - 1);
+
+	for (s = 1; s < nt; s++)
+		_pool_push(t + s);
+	_pool_run(t);
+	for (s = 1; s < nt; s++)
+		_pool_join(t + s);
+
+	// output positions, bucket by bucket, chunk by chunk within a bucket
+	sum = 0;
+	nb = 0;
+	for (b = 0; b < 2 * SAMPLE_BUCKETS; b++) {
+		u[nb].p = (int)sum;
+		for (s = 0; s < nt; s++) {
+			c = t[s].cnt[b];
+			t[s].cnt[b] = sum;
+			sum += c;
+		}
+		// the buckets of numbers equal to a splitter are sorted already
+		if (b % 2 == 0 && sum - u[nb].p > 1) {
+			u[nb].kind = 'u';
+			u[nb].a = a;
+			u[nb].tmp = tmp;
+			u[nb].r = (int)sum - 1;
+			nb++;
+		}
+	}
+
+	for (s = 0; s < nt; s++)
+		t[s].kind = 'd';
+	for (s = 1; s < nt; s++)
+		_pool_push(t + s);
+	_pool_run(t);
+	for (s = 1; s < nt; s++)
+		_pool_join(t + s);
+
+	// the untouched equal buckets are copied back by the first thread meanwhile
+	for (b = 0; b < nb; b++)
+		_pool_push(u + b);
+	for (b = 0, sum = 0; b < nb; sum = u[b].r + 1, b++) {
+		if ((unsigned)u[b].p > sum)
+			memcpy((void *)(a + sum), (void *)(tmp + sum), (u[b].p - sum) * sizeof(int));
+	}
+	if (sum < (unsigned)n)
+		memcpy((void *)(a + sum), (void *)(tmp + sum), (n - sum) * sizeof(int));
+	for (b = 0; b < nb; b++)
+		_pool_join(u + b);
+
+	_pool_stop();
+
+	free((void *)cnt);
+	free((void *)u);
+	free((void *)t);
+	free((void *)tmp);
+}
+
+/* picks SAMPLE_BUCKETS - 1 splitters, evenly spaced in a sorted sample of
+   SAMPLE_OVERSAMPLE numbers per bucket, and lays them out as a tree */
+void _sample_splitters(int *a, int n) {
+	int smp[SAMPLE_BUCKETS * SAMPLE_OVERSAMPLE];
+	int i, j, l;
+
+	for (i = 0; i < SAMPLE_BUCKETS * SAMPLE_OVERSAMPLE; i++) {
+		smp[i] = a[_bench_hash(i) % (uint64_t)n];
+	}
+	_sort_pdq(smp, SAMPLE_BUCKETS * SAMPLE_OVERSAMPLE);
+
+	for (i = 0; i < SAMPLE_BUCKETS - 1; i++) {
+		_spl[i] = smp[(i + 1) * SAMPLE_OVERSAMPLE - 1];
+	}
+	_spl[SAMPLE_BUCKETS - 1] = INT_MAX;
+
+	// the node j at the level l, the i-th of the level, is the middle of its range
+	for (j = 1; j < SAMPLE_BUCKETS; j++) {
+		l = 31 - __builtin_clz(j);
+		i = j - (1 << l);
+		_spl_tree[j] = _spl[(2 * i + 1) * (SAMPLE_BUCKETS >> (l + 1)) - 1];
+	}
+}
+
+/* finds the buckets of a[p..r] going down the splitter tree without branches,
+   SAMPLE_UNROLL numbers at a time, bucket 2b for _spl[b - 1] < x < _spl[b] and
+   2b + 1 for x == _spl[b]; counts them in cnt or, with dst, scatters them to
+   dst at the positions cnt */
+void _sample_pass(int *a, int p, int r, unsigned *cnt, int *dst) {
+	int j[SAMPLE_UNROLL];
+	int i, k, l, x;
+
+	for (i = p; i <= r; i += SAMPLE_UNROLL) {
+		if (i + SAMPLE_UNROLL - 1 > r) {
+			// the tail
+			for (; i <= r; i++) {
+				x = a[i];
+				for (l = 0, k = 1; l < SAMPLE_LOG; l++)
+					k = 2 * k + (x > _spl_tree[k]);
+				k -= SAMPLE_BUCKETS;
+				k = 2 * k + (x == _spl[k]);
+				if (dst != NULL)
+					dst[cnt[k]++] = x;
+				else
+					cnt[k]++;
+			}
+			break;
+		}
+
+		// independent descents overlap their loads
+		for (k = 0; k < SAMPLE_UNROLL; k++)
+			j[k] = 1;
+		for (l = 0; l < SAMPLE_LOG; l++) {
+			for (k = 0; k < SAMPLE_UNROLL; k++)
+				j[k] = 2 * j[k] + (a[i + k] > _spl_tree[j[k]]);
+		}
+		for (k = 0; k < SAMPLE_UNROLL; k++) {
+			j[k] -= SAMPLE_BUCKETS;
+			j[k] = 2 * j[k] + (a[i + k] == _spl[j[k]]);
+		}
+
+		if (dst != NULL) {
+			for (k = 0; k < SAMPLE_UNROLL; k++)
+				dst[cnt[j[k]]++] = a[i + k];
+		} else {
+			for (k = 0; k < SAMPLE_UNROLL; k++)
+				cnt[j[k]]++;
+		}
+	}
+}
+
+void _sort_pdq(int *a, int n) {
+	int bad = 0;
+
+	// unbalanced partitions allowed before the heapsort, log2(n)
+	while ((n >> bad) > 1)
+		bad++;
+	_pdq_loop(a, a + n, bad, 1);
+}
+
+/* sorts [begin, end), recursing into the left part and looping on the right one,
+   leftmost is set when there is no smaller number before begin */
+void _pdq_loop(int *begin, int *end, int bad, int leftmost) {
+	int *pivot, t;
+	int n, h, nl, nr, sorted;
+
+	for (;;) {
+		n = end - begin;
+		if (n < PDQ_INSERT_LEN) {
+			_sort_insert(begin, 0, n - 1);
+			return;
+		}
+
+		// the median of 3, or the pseudomedian of 9 for bigger ranges, to begin
+		h = n / 2;
+		if (n > PDQ_NINTHER_LEN) {
+			_pdq_sort3(begin, begin + h, end - 1);
+			_pdq_sort3(begin + 1, begin + (h - 1), end - 2);
+			_pdq_sort3(begin + 2, begin + (h + 1), end - 3);
+			_pdq_sort3(begin + (h - 1), begin + h, begin + (h + 1));
+			t = *begin;
+			*begin = begin[h];
+			begin[h] = t;
+		} else {
+			_pdq_sort3(begin + h, begin, end - 1);
+		}
+
+		// a pivot equal to the number before the range is its smallest number,
+		// then the numbers equal to it go left and only the right part is left to sort
+		if (!leftmost && !(*(begin - 1) < *begin)) {
+			begin = _pdq_partition_left(begin, end) + 1;
+			continue;
+		}
+
+		pivot = _pdq_partition_right(begin, end, &sorted);
+		nl = pivot - begin;
+		nr = end - (pivot + 1);
+
+		if (nl < n / 8 || nr < n / 8) {
+			// a bad pivot, after log2(n) of them the heapsort guarantees O(n log n)
+			if (--bad == 0) {
+				_sort_heap(begin, end);
+				return;
+			}
+
+			// shuffle some numbers to break the pattern that caused it
+			if (nl >= PDQ_INSERT_LEN) {
+				t = begin[0]; begin[0] = begin[nl / 4]; begin[nl / 4] = t;
+				t = pivot[-1]; pivot[-1] = pivot[-nl / 4]; pivot[-nl / 4] = t;
+				if (nl > PDQ_NINTHER_LEN) {
+					t = begin[1]; begin[1] = begin[nl / 4 + 1]; begin[nl / 4 + 1] = t;
+					t = begin[2]; begin[2] = begin[nl / 4 + 2]; begin[nl / 4 + 2] = t;
+					t = pivot[-2]; pivot[-2] = pivot[-(nl / 4 + 1)]; pivot[-(nl / 4 + 1)] = t;
+					t = pivot[-3]; pivot[-3] = pivot[-(nl / 4 + 2)]; pivot[-(nl / 4 + 2)] = t;
+				}
+			}
+			if (nr >= PDQ_INSERT_LEN) {
+				t = pivot[1]; pivot[1] = pivot[1 + nr / 4]; pivot[1 + nr / 4] = t;
+				t = end[-1]; end[-1] = end[-nr / 4]; end[-nr / 4] = t;
+				if (nr > PDQ_NINTHER_LEN) {
+					t = pivot[2]; pivot[2] = pivot[2 + nr / 4]; pivot[2 + nr / 4] = t;
+					t = pivot[3]; pivot[3] = pivot[3 + nr / 4]; pivot[3 + nr / 4] = t;
+					t = end[-2]; end[-2] = end[-(1 + nr / 4)]; end[-(1 + nr / 4)] = t;
+					t = end[-3]; end[-3] = end[-(2 + nr / 4)]; end[-(2 + nr / 4)] = t;
+				}
+			}
+		} else if (sorted && _pdq_partial_insert(begin, pivot) && _pdq_partial_insert(pivot + 1, end)) {
+			// a range that was partitioned already and whose parts were nearly sorted
+			return;
+		}
+
+		_pdq_loop(begin, pivot, bad, leftmost);
+		begin = pivot + 1;
+		leftmost = 0;
+	}
+}
+
+/* partitions [begin, end) around the pivot *begin into the numbers less than it and
+   the rest, returns the final position of the pivot, sets sorted when no number had
+   to move. The numbers on the wrong sides are found a block at a time, their offsets
+   are stored without branches, then they are swapped in pairs (BlockQuicksort). */
+int *_pdq_partition_right(int *begin, int *end, int *sorted) {
+	unsigned char offl[PDQ_BLOCK_LEN], offr[PDQ_BLOCK_LEN];
+	int *first = begin, *last = end, *basel, *baser, *l, *r;
+	int pivot = *begin, t;
+	long nl, nr, sl, sr, num, unknown, splitl, splitr, i;
+
+	// the median of 3 guarantees a number >= pivot on the right
+	while (*++first < pivot);
+	if (first - 1 == begin) {
+		while (first < last && !(*--last < pivot));
+	} else {
+		while (!(*--last < pivot));
+	}
+
+	*sorted = first >= last;
+	if (!*sorted) {
+		t = *first;
+		*first = *last;
+		*last = t;
+		++first;
+
+		basel = first;
+		baser = last;
+		nl = nr = sl = sr = 0;
+		while (first < last) {
+			// fill the blocks of an empty side, splitting what is left when both are
+			unknown = last - first;
+			splitl = nl == 0 ? (nr == 0 ? unknown / 2 : unknown) : 0;
+			splitr = nr == 0 ? unknown - splitl : 0;
+			splitl = splitl < PDQ_BLOCK_LEN ? splitl : PDQ_BLOCK_LEN;
+			splitr = splitr < PDQ_BLOCK_LEN ? splitr : PDQ_BLOCK_LEN;
+
+			for (i = 0; i < splitl; i++) {
+				offl[nl] = (unsigned char)i;
+				nl += !(*first++ < pivot);
+			}
+			for (i = 0; i < splitr; ) {
+				offr[nr] = (unsigned char)++i;
+				nr += *--last < pivot;
+			}
+
+			// swap the pairs, a cyclic permutation needs fewer moves than swaps,
+			// the swaps keep descending inputs O(n)
+			num = nl < nr ? nl : nr;
+			if (nl == nr) {
+				for (i = 0; i < num; i++) {
+					l = basel + offl[sl + i];
+					r = baser - offr[sr + i];
+					t = *l;
+					*l = *r;
+					*r = t;
+				}
+			} else if (num > 0) {
+				l = basel + offl[sl];
+				r = baser - offr[sr];
+				t = *l;
+				*l = *r;
+				for (i = 1; i < num; i++) {
+					l = basel + offl[sl + i];
+					*r = *l;
+					r = baser - offr[sr + i];
+					*l = *r;
+				}
+				*r = t;
+			}
+			nl -= num;
+			nr -= num;
+			sl += num;
+			sr += num;
+			if (nl == 0) {
+				sl = 0;
+				basel = first;
+			}
+			if (nr == 0) {
+				sr = 0;
+				baser = last;
+			}
+		}
+
+		// the numbers left in a block go to the other end of the range
+		if (nl) {
+			while (nl--) {
+				l = basel + offl[sl + nl];
+				t = *l;
+				*l = *--last;
+				*last = t;
+			}
+			first = last;
+		}
+		if (nr) {
+			while (nr--) {
+				r = baser - offr[sr + nr];
+				t = *r;
+				*r = *first;
+				*first++ = t;
+			}
+		}
+	}
+
+	// the pivot to its place
+	*begin = *(first - 1);
+	*(first - 1) = pivot;
+	return first - 1;
+}
+
+/* partitions [begin, end) into the numbers equal to the pivot *begin, which is the
+   smallest, and the greater ones, returns the position of the last equal number */
+int *_pdq_partition_left(int *begin, int *end) {
+	int *first = begin, *last = end;
+	int pivot = *begin, t;
+
+	while (pivot < *--last);
+	if (last + 1 == end) {
+		while (first < last && !(pivot < *++first));
+	} else {
+		while (!(pivot < *++first));
+	}
+
+	while (first < last) {
+		t = *first;
+		*first = *last;
+		*last = t;
+		while (pivot < *--last);
+		while (!(pivot < *++first));
+	}
+
+	*begin = *last;
+	*last = pivot;
+	return last;
+}
+
+/* the insertion sort of [begin, end) that gives up after PDQ_PARTIAL_MOVES moves,
+   returns 1 when the range is sorted */
+int _pdq_partial_insert(int *begin, int *end) {
+	int *cur, *sift;
+	int moves = 0, t;
+
+	if (begin == end)
+		return 1;
+
+	for (cur = begin + 1; cur != end; cur++) {
+		if (*cur < *(cur - 1)) {
+			t = *cur;
+			sift = cur;
+			do {
+				*sift = *(sift - 1);
+				sift--;
+			} while (sift != begin && t < *(sift - 1));
+			*sift = t;
+			moves += cur - sift;
+		}
+		if (moves > PDQ_PARTIAL_MOVES)
+			return 0;
+	}
+	return 1;
+}
+
+/* sorts *a <= *b <= *c */
+void _pdq_sort3(int *a, int *b, int *c) {
+	int t;
+
+	if (*b < *a) {
+		t = *a; *a = *b; *b = t;
+	}
+	if (*c < *b) {
+		t = *b; *b = *c; *c = t;
+	}
+	if (*b < *a) {
+		t = *a; *a = *b; *b = t;
+	}
+}
+
+/* heapsort of [begin, end), a max-heap sifted down from the last parent */
+void _sort_heap(int *begin, int *end) {
+	int n = end - begin;
+	int i, j, k, m, t;
+
+	for (i = n / 2 - 1; i >= -n + 1; i--) {
+		// build the heap while i >= 0, then move the max past the heap of m numbers
+		if (i >= 0) {
+			k = i;
+			m = n;
+		} else {
+			m = n + i;
+			t = begin[0];
+			begin[0] = begin[m];
+			begin[m] = t;
+			k = 0;
+		}
+
+		t = begin[k];
+		while ((j = 2 * k + 1) < m) {
+			if (j + 1 < m && begin[j] < begin[j + 1])
+				j++;
+			if (!(t < begin[j]))
+				break;
+			begin[k] = begin[j];
+			k = j;
+		}
+		begin[k] = t;
+	}
+}
+
+/* block merge sort in the way of GrailSort: the first distinct numbers of the array
+   become its only scratch space. 2 sqrt(n) of them are collected at the front with
+   rotations: sqrt(n) tags that label the blocks of a merge, and an internal buffer
+   of sqrt(n) that merges by swapping, so its numbers are only permuted. The rest is
+   sorted into runs of 2 sqrt(n) through the buffer, then pairs of runs are merged
+   by blocks of sqrt(n): the blocks are selection sorted by their first number (the
+   tags keep the blocks of the left run first among equal ones), then every block is
+   merged locally with the remainder before it. At the end the tags and the buffer
+   are insertion sorted and merged back without a buffer. With fewer distinct numbers
+   the tags alone serve as a smaller buffer, or the merges do without one. The fixed
+   buffer of _ip_buf_len numbers only speeds up the first passes and the rotations */
+void _sort_inplace(int *a, int n) {
+	int bl, nkeys, found, ptr, cbuf, lb, nk, havebuf, chavebuf;
+	long s;
+
+	if (n < 16) {
+		_sort_insert(a, 0, n - 1);
+		return;
+	}
+
+	for (bl = 1; bl * bl < n; bl *= 2);
+	nkeys = (n - 1) / bl + 1;
+	found = _ip_find_keys(a, n, nkeys + bl);
+	havebuf = 1;
+	if (found < nkeys + bl) {
+		if (found < 4) {
+			// too few distinct numbers for anything, merge runs without a buffer
+			_ip_lazy_sort(a, n);
+			return;
+		}
+		for (nkeys = bl; nkeys > found; nkeys /= 2);
+		havebuf = 0;
+		bl = 0;
+	}
+	ptr = bl + nkeys;
+	cbuf = havebuf ? bl : nkeys;
+	_ip_build_blocks(a + ptr, n - ptr, cbuf);
+
+	// runs of 2 cbuf are sorted
+	while (n - ptr > (cbuf *= 2)) {
+		lb = bl;
+		chavebuf = havebuf;
+		if (!havebuf) {
+			if (nkeys > 4 && nkeys / 8 * nkeys >= cbuf) {
+				// half of the tags as the buffer
+				lb = nkeys / 2;
+				chavebuf = 1;
+			} else {
+				// blocks as small as the tags allow, merged without a buffer
+				nk = 1;
+				s = (long)cbuf * found / 2;
+				while (nk < nkeys && s != 0) {
+					nk *= 2;
+					s /= 8;
+				}
+				lb = (2 * cbuf) / nk;
+			}
+		}
+		_ip_combine_blocks(a, a + ptr, n - ptr, cbuf, lb, chavebuf);
+	}
+	_sort_insert(a, 0, ptr - 1);
+	_ip_merge_nb(a, ptr, n - ptr);
+}
+
+/* moves the first occurrences of up to want distinct numbers to the front, sorted,
+   the rest keeps its order; returns how many there are */
+int _ip_find_keys(int *a, int n, int want) {
+	int h = 1, h0 = 0, u, r;
+
+	// the keys are a[h0..h0+h), rolled along the array as it is scanned
+	for (u = 1; u < n && h < want; u++) {
+		r = _gallop_left(a[u], a + h0, h);
+		if (r == h || a[h0 + r] != a[u]) {
+			_ip_rotate(a + h0, h, u - (h0 + h));
+			h0 = u - h;
+			_ip_rotate(a + h0 + r, h - r, 1);
+			h++;
+		}
+	}
+	_ip_rotate(a, h0, h);
+	return h;
+}
+
+/* sorts a[0..n) into runs of 2k with the buffer of k numbers a[-k..0), which ends
+   where it started; the first passes move numbers through the fixed buffer */
+void _ip_build_blocks(int *a, int n, int k) {
+	int m, u, h, p0, p1, rest, kbuf;
+
+	kbuf = k < _ip_buf_len ? k : _ip_buf_len;
+	while (kbuf & (kbuf - 1))
+		kbuf &= kbuf - 1;
+
+	if (kbuf >= 2) {
+		// the buffer numbers wait in the fixed buffer, the passes just copy
+		memcpy((void *)_ip_buf, (void *)(a - kbuf), kbuf * sizeof(int));
+		for (m = 1; m < n; m += 2) {
+			u = a[m - 1] > a[m];
+			a[m - 3] = a[m - 1 + u];
+			a[m - 2] = a[m - u];
+		}
+		if (n % 2)
+			a[n - 3] = a[n - 1];
+		a -= 2;
+		for (h = 2; h < kbuf; h *= 2) {
+			p0 = 0;
+			p1 = n - 2 * h;
+			while (p0 <= p1) {
+				_ip_merge_left_x(a + p0, h, h, -h);
+				p0 += 2 * h;
+			}
+			rest = n - p0;
+			if (rest > h) {
+				_ip_merge_left_x(a + p0, h, rest - h, -h);
+			} else {
+				for (; p0 < n; p0++)
+					a[p0 - h] = a[p0];
+			}
+			a -= h;
+		}
+		memcpy((void *)(a + n), (void *)_ip_buf, kbuf * sizeof(int));
+	} else {
+		// pairs, swapped with the buffer
+		for (m = 1; m < n; m += 2) {
+			u = a[m - 1] > a[m];
+			_ip_swap_n(a + m - 3, a + m - 1 + u, 1);
+			_ip_swap_n(a + m - 2, a + m - u, 1);
+		}
+		if (n % 2)
+			_ip_swap_n(a + n - 1, a + n - 3, 1);
+		a -= 2;
+		h = 2;
+	}
+
+	// every pass moves the runs left by h and the buffer right behind them
+	for (; h < k; h *= 2) {
+		p0 = 0;
+		p1 = n - 2 * h;
+		while (p0 <= p1) {
+			_ip_merge_left(a + p0, h, h, -h);
+			p0 += 2 * h;
+		}
+		rest = n - p0;
+		if (rest > h)
+			_ip_merge_left(a + p0, h, rest - h, -h);
+		else
+			_ip_rotate(a + p0 - h, h, rest);
+		a -= h;
+	}
+
+	// the last pass goes from the right and brings the buffer back to the front
+	rest = n % (2 * k);
+	p0 = n - rest;
+	if (rest <= k)
+		_ip_rotate(a + p0, rest, k);
+	else
+		_ip_merge_right(a + p0, k, rest - k, k);
+	while (p0 > 0) {
+		p0 -= 2 * k;
+		_ip_merge_right(a + p0, k, k, k);
+	}
+}
+
+/* merges the pairs of runs of ll in a[0..n) by blocks of bl, tagged by keys;
+   the buffer of bl numbers is a[-bl..0) when havebuf */
+void _ip_combine_blocks(int *keys, int *a, int n, int ll, int bl, int havebuf) {
+	int m, b, nblk, midkey, rest, u, p, v, nafter, last;
+	int *a1;
+
+	m = n / (2 * ll);
+	rest = n % (2 * ll);
+	if (rest <= ll) {
+		// a lonely run at the end stays as it is
+		n -= rest;
+		rest = 0;
+	}
+
+	for (b = 0; b <= m; b++) {
+		if (b == m && rest == 0)
+			break;
+		a1 = a + b * 2 * ll;
+		nblk = (b == m ? rest : 2 * ll) / bl;
+		_sort_insert(keys, 0, nblk + (b == m) - 1);
+
+		// the keys before midkey tag the blocks of the left run
+		midkey = ll / bl;
+		for (u = 1; u < nblk; u++) {
+			p = u - 1;
+			for (v = u; v < nblk; v++) {
+				if (a1[p * bl] > a1[v * bl] || (a1[p * bl] == a1[v * bl] && keys[p] > keys[v]))
+					p = v;
+			}
+			if (p != u - 1) {
+				_ip_swap_n(a1 + (u - 1) * bl, a1 + p * bl, bl);
+				_ip_swap_n(keys + u - 1, keys + p, 1);
+				if (midkey == u - 1 || midkey == p)
+					midkey ^= (u - 1) ^ p;
+			}
+		}
+
+		// the left blocks that go after the short last block of the right run
+		nafter = 0;
+		last = b == m ? rest % bl : 0;
+		if (last != 0) {
+			while (nafter < nblk && a1[nblk * bl] < a1[(nblk - nafter - 1) * bl])
+				nafter++;
+		}
+		_ip_merge_blocks(keys, keys[midkey], a1, nblk - nafter, bl, havebuf, nafter, last);
+	}
+
+	// the buffer went to the end, bring it back before the runs
+	if (havebuf) {
+		while (--n >= 0)
+			_ip_swap_n(a + n, a + n - bl, 1);
+	}
+}
+
+/* merges the sorted blocks of a[0..nblock * bl), then nafter left blocks
+   and a last right block of last numbers, each block with the remainder before it */
+void _ip_merge_blocks(int *keys, int midkey, int *a, int nblock, int bl, int havebuf,
+		int nafter, int last) {
+	int lrest, frest, fnext, prest, pidx, c;
+
+	if (nblock == 0) {
+		if (havebuf)
+			_ip_merge_left(a, nafter * bl, last, -bl);
+		else
+			_ip_merge_nb(a, nafter * bl, last);
+		return;
+	}
+
+	// the remainder a[prest..prest+lrest) comes from the left run when frest is 0
+	lrest = bl;
+	frest = keys[0] < midkey ? 0 : 1;
+	pidx = bl;
+	for (c = 1; c < nblock; c++, pidx += bl) {
+		prest = pidx - lrest;
+		fnext = keys[c] < midkey ? 0 : 1;
+		if (fnext == frest) {
+			if (havebuf)
+				_ip_swap_n(a + prest - bl, a + prest, lrest);
+			lrest = bl;
+		} else if (havebuf) {
+			_ip_smart_merge(a + prest, &lrest, &frest, bl, bl);
+		} else {
+			_ip_smart_merge_nb(a + prest, &lrest, &frest, bl);
+		}
+	}
+	prest = pidx - lrest;
+	if (last != 0) {
+		if (frest) {
+			if (havebuf)
+				_ip_swap_n(a + prest - bl, a + prest, lrest);
+			prest = pidx;
+			lrest = bl * nafter;
+		} else {
+			lrest += bl * nafter;
+		}
+		if (havebuf)
+			_ip_merge_left(a + prest, lrest, last, -bl);
+		else
+			_ip_merge_nb(a + prest, lrest, last);
+	} else if (havebuf) {
+		_ip_swap_n(a + prest, a + prest - bl, lrest);
+	}
+}
+
+/* merges the remainder a[0..*len1) of the type *type (0 for the left run) with the
+   next block of len2 through the buffer of m numbers before it, as far as one of
+   them lasts; the rest of the other becomes the remainder */
+void _ip_smart_merge(int *a, int *len1, int *type, int len2, int m) {
+	int p0 = -m, p1 = 0, p2 = *len1, q1 = p2, q2 = p2 + len2;
+	int ftype = 1 - *type;
+
+	// ties go to the left run, whichever side it is on
+	while (p1 < q1 && p2 < q2) {
+		if (ftype ? a[p1] <= a[p2] : a[p1] < a[p2])
+			_ip_swap_n(a + p0++, a + p1++, 1);
+		else
+			_ip_swap_n(a + p0++, a + p2++, 1);
+	}
+	if (p1 < q1) {
+		*len1 = q1 - p1;
+		while (p1 < q1)
+			_ip_swap_n(a + --q1, a + --q2, 1);
+	} else {
+		*len1 = q2 - p2;
+		*type = ftype;
+	}
+}
+
+/* _ip_smart_merge without a buffer, by rotations */
+void _ip_smart_merge_nb(int *a, int *len1, int *type, int len2) {
+	int n1 = *len1, n2 = len2, ftype = 1 - *type, h;
+
+	if (len2 == 0)
+		return;
+	if (n1 && (ftype ? a[n1 - 1] > a[n1] : a[n1 - 1] >= a[n1])) {
+		while (n1) {
+			h = ftype ? _gallop_left(a[0], a + n1, n2) : _gallop_right(a[0], a + n1, n2);
+			if (h != 0) {
+				_ip_rotate(a, n1, h);
+				a += h;
+				n2 -= h;
+			}
+			if (n2 == 0) {
+				*len1 = n1;
+				return;
+			}
+			do {
+				a++;
+				n1--;
+			} while (n1 && (ftype ? a[0] <= a[n1] : a[0] < a[n1]));
+		}
+	}
+	*len1 = n2;
+	*type = ftype;
+}
+
+/* merges a[0..l1) and a[l1..l1+l2) into a[m..m+l1+l2), m < 0, swapping with
+   the buffer there, which ends up behind them */
+void _ip_merge_left(int *a, int l1, int l2, int m) {
+	int p0 = 0, p1 = l1;
+
+	l2 += l1;
+	while (p1 < l2) {
+		if (p0 == l1 || a[p0] > a[p1])
+			_ip_swap_n(a + m++, a + p1++, 1);
+		else
+			_ip_swap_n(a + m++, a + p0++, 1);
+	}
+	if (m != p0)
+		_ip_swap_n(a + m, a + p0, l1 - p0);
+}
+
+/* _ip_merge_left with copies, the buffer numbers are kept elsewhere */
+void _ip_merge_left_x(int *a, int l1, int l2, int m) {
+	int p0 = 0, p1 = l1;
+
+	l2 += l1;
+	while (p1 < l2)
+		a[m++] = p0 == l1 || a[p0] > a[p1] ? a[p1++] : a[p0++];
+	while (p0 < l1)
+		a[m++] = a[p0++];
+}
+
+/* merges a[0..l1) and a[l1..l1+l2) into a[m..m+l1+l2), swapping with the buffer
+   of m numbers behind them, which ends up in front */
+void _ip_merge_right(int *a, int l1, int l2, int m) {
+	int p0 = l1 + l2 + m - 1, p2 = l1 + l2 - 1, p1 = l1 - 1;
+
+	while (p1 >= 0) {
+		if (p2 < l1 || a[p1] > a[p2])
+			_ip_swap_n(a + p0--, a + p1--, 1);
+		else
+			_ip_swap_n(a + p0--, a + p2--, 1);
+	}
+	if (p2 != p0) {
+		while (p2 >= l1)
+			_ip_swap_n(a + p0--, a + p2--, 1);
+	}
+}
+
+/* merges a[0..l1) and a[l1..l1+l2) without a buffer: the shorter side goes into
+   the other by binary searches and rotations, O(n + l^2) moves for the shorter l */
+void _ip_merge_nb(int *a, int l1, int l2) {
+	int h;
+
+	if (l1 < l2) {
+		while (l1) {
+			h = _gallop_left(a[0], a + l1, l2);
+			if (h != 0) {
+				_ip_rotate(a, l1, h);
+				a += h;
+				l2 -= h;
+			}
+			if (l2 == 0)
+				break;
+			do {
+				a++;
+				l1--;
+			} while (l1 && a[0] <= a[l1]);
+		}
+	} else {
+		while (l2) {
+			h = _gallop_right(a[l1 + l2 - 1], a, l1);
+			if (h != l1) {
+				_ip_rotate(a + h, l1 - h, l2);
+				l1 = h;
+			}
+			if (l1 == 0)
+				break;
+			do {
+				l2--;
+			} while (l2 && a[l1 - 1] <= a[l1 + l2 - 1]);
+		}
+	}
+}
+
+/* bottom-up merge sort with merges without a buffer, for inputs of up to 3
+   distinct numbers, where every merge is a few rotations */
+void _ip_lazy_sort(int *a, int n) {
+	int m, h, p0, rest;
+
+	for (m = 1; m < n; m += 2) {
+		if (a[m - 1] > a[m])
+			_ip_swap_n(a + m - 1, a + m, 1);
+	}
+	for (h = 2; h < n; h *= 2) {
+		for (p0 = 0; p0 + 2 * h <= n; p0 += 2 * h)
+			_ip_merge_nb(a + p0, h, h);
+		rest = n - p0;
+		if (rest > h)
+			_ip_merge_nb(a + p0, h, rest - h);
+	}
+}
+
+/* swaps a[0..l1) and a[l1..l1+l2): through the fixed buffer when the smaller one
+   fits, otherwise by swapping the smaller one across and going on with the rest */
+void _ip_rotate(int *a, int l1, int l2) {
+	if (l1 == 0 || l2 == 0)
+		return;
+	if (l1 <= l2 && l1 <= _ip_buf_len) {
+		memcpy((void *)_ip_buf, (void *)a, l1 * sizeof(int));
+		memmove((void *)a, (void *)(a + l1), l2 * sizeof(int));
+		memcpy((void *)(a + l2), (void *)_ip_buf, l1 * sizeof(int));
+		return;
+	}
+	if (l2 < l1 && l2 <= _ip_buf_len) {
+		memcpy((void *)_ip_buf, (void *)(a + l1), l2 * sizeof(int));
+		memmove((void *)(a + l2), (void *)a, l1 * sizeof(int));
+		memcpy((void *)a, (void *)_ip_buf, l2 * sizeof(int));
+		return;
+	}
+	while (l1 && l2) {
+		if (l1 <= l2) {
+			_ip_swap_n(a, a + l1, l1);
+			a += l1;
+			l2 -= l1;
+		} else {
+			_ip_swap_n(a + l1 - l2, a + l1, l2);
+			l1 -= l2;
+		}
+	}
+}
+
+void _ip_swap_n(int *a, int *b, int n) {
+	int t;
+
+	while (n-- > 0) {
+		t = *a;
+		*a++ = *b;
+		*b++ = t;
+	}
+}
+
+/* sorts blocks that fit into the L2 cache with the -Oi kernel, then merges
+   _mw_fanin runs at a time between the array and a scratch buffer, so the passes
+   over the memory are log_k of the number of blocks instead of log_2 */
+void _sort_multiway(int *a, int n) {
+	long bnd[MW_MAX_FANIN + 1];
+	long block, w, p, bytes;
+	int *src, *dst, *tmp;
+	int i, k, passes = 0;
+
+	// the array and the temporaries of its merges fit into the cache together
+	block = sysconf(_SC_LEVEL2_CACHE_SIZE);
+	if (block <= 0)
+		block = MW_L2_SIZE;
+	block /= 2 * sizeof(int);
+
+	for (w = block; w < n; w *= _mw_fanin) {
+		passes++;
+	}
+	src = a;
+	dst = passes > 0 ? (int *)malloc(n * sizeof(int)) : a;
+	if (passes % 2 == 1) {
+		// an odd number of passes ends in the array when the blocks start in the buffer
+		tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+
+	// the copy to the buffer comes with the block, while it is in the cache anyway
+	for (p = 0; p < n; p += block) {
+		i = (int)(p + block < n ? p + block : n);
+		if (src != a)
+			memcpy((void *)(src + p), (void *)(a + p), (i - p) * sizeof(int));
+		_sort_merge_i(src, (int)p, i - 1);
+	}
+	bytes = 2 * (long)n * sizeof(int);
+
+	for (w = block; w < n; w *= _mw_fanin) {
+		for (p = 0; p < n; p += w * _mw_fanin) {
+			for (k = 0; k < _mw_fanin && p + k * w < n; k++) {
+				bnd[k] = p + k * w;
+			}
+			bnd[k] = p + k * w < n ? p + k * w : n;
+			if (k == 1) {
+				// a lonely run, carried over to the other side
+				memcpy((void *)(dst + p), (void *)(src + p), (bnd[1] - p) * sizeof(int));
+				continue;
+			}
+			_mw_merge(src, dst, bnd, k);
+		}
+		tmp = src;
+		src = dst;
+		dst = tmp;
+		bytes += 2 * (long)n * sizeof(int);
+	}
+	if (dst != a)
+		free((void *)dst);
+
+	if (_timing) {
+		for (i = 0, w = block; w < n; w *= 2, i++);
+		fprintf(stderr, "multiway merge: %d blocks of %ld numbers, %d passes of fan-in %d "
+			"(%d with binary merges), %ld bytes moved\n", (int)((n + block - 1) / block), block,
+			passes, _mw_fanin, i, bytes);
+	}
+}
+
+/* merges the k runs src[bnd[i]..bnd[i+1]-1] into dst[bnd[0]..bnd[k]-1].
+   The tree holds keys instead of run indices, so a match is one 64-bit compare
+   (the run index breaks ties, which keeps the merge stable), and the number
+   comes back from the key of the winner without a load */
+void _mw_merge(int *src, int *dst, long *bnd, int k) {
+	uint64_t tree[MW_MAX_FANIN], leaf[MW_MAX_FANIN];
+	long pos[MW_MAX_FANIN];
+	uint64_t x, y;
+	long o;
+	int i, s, t;
+
+	for (i = 0; i < k; i++) {
+		pos[i] = bnd[i];
+		leaf[i] = (uint64_t)((unsigned)src[pos[i]] ^ 0x80000000u) << 32 | i;
+	}
+	tree[0] = _mw_build(tree, leaf, k, 1);
+
+	for (o = bnd[0]; o < bnd[k]; o++) {
+		x = tree[0];
+		s = (int)(x & 0xffffffffu);
+		dst[o] = (int)((unsigned)(x >> 32) ^ 0x80000000u);
+
+		pos[s]++;
+		x = pos[s] < bnd[s + 1] ? (uint64_t)((unsigned)src[pos[s]] ^ 0x80000000u) << 32 | s : MW_DONE;
+
+		// the smaller key goes on, the bigger one stays as the loser, without branches
+		for (t = (s + k) / 2; t > 0; t /= 2) {
+			y = tree[t];
+			tree[t] = y > x ? y : x;
+			x = y < x ? y : x;
+		}
+		tree[0] = x;
+	}
+}
+
+/* plays the matches of the subtree at node, stores the losers and returns the winner */
+uint64_t _mw_build(uint64_t *tree, uint64_t *leaf, int k, int node) {
+	uint64_t w1, w2;
+
+	if (node >= k)
+		return leaf[node - k];
+
+	w1 = _mw_build(tree, leaf, k, 2 * node);
+	w2 = _mw_build(tree, leaf, k, 2 * node + 1);
+	tree[node] = w1 > w2 ? w1 : w2;
+	return w1 < w2 ? w1 : w2;
+}
+
+void _k_insert(int *a, int n) {
+	_sort_insert(a, 0, n - 1);
+}
+
+void _k_merge(int *a, int n) {
+	_sort_merge(a, 0, n - 1);
+}
+
+void _k_merge_s(int *a, int n) {
+	_sort_merge_s(a, 0, n - 1);
+}
+
+void _k_merge_i(int *a, int n) {
+	_sort_merge_i(a, 0, n - 1);
+}
+
+/* runs every kernel on sizes 100, 1000, ... up to maxn of every distribution,
+   prints a row per run in CSV or JSON (fmt 'c' or 'j'), returns 1 when a result
+   is not sorted */
+int _bench(long maxn, char fmt) {
+	const char *dists = "usrnfo";
+	struct _kernel *k;
+	double *t, t1, med, mean, var;
+	long n, i, rss;
+	int *src, *a, runs, r, j, ok, failed = 0, rows = 0;
+	uint64_t sum, sum2;
+
+	if (_nthreads <= 0) {
+		_nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if (_nthreads <= 0)
+			_nthreads = 1;
+	}
+
+	if (fmt == 'j') {
+		printf("[\n");
+	} else {
+		printf("kernel,dist,n,threads,runs,median_ns,ns_per_elem,melem_per_s,mean_ns,stddev_ns,peak_rss_kb,sorted\n");
+	}
+
+	t = (double *)malloc(BENCH_MAX_RUNS * sizeof(double));
+	for (n = 100; n <= maxn; n *= 10) {
+		src = (int *)malloc(n * sizeof(int));
+		a = (int *)malloc(n * sizeof(int));
+
+		// about BENCH_WORK numbers sorted per size, warmed up unless a single run is long
+		runs = (int)(BENCH_WORK / n);
+		runs = runs < 3 ? 3 : runs > BENCH_MAX_RUNS ? BENCH_MAX_RUNS : runs;
+
+		for (j = 0; dists[j] != '\0'; j++) {
+			_bench_gen(src, n, dists[j]);
+			for (sum = 0, i = 0; i < n; i++)
+				sum += (uint32_t)src[i];
+
+			for (k = _kernels; k->name != NULL; k++) {
+				if (k->max_n > 0 && n > k->max_n)
+					continue;
+
+				ok = 1;
+				_rss_reset();
+				for (r = n <= BENCH_WORK / 10 ? -1 : 0; r < runs; r++) {
+					memcpy((void *)a, (void *)src, n * sizeof(int));
+					t1 = _now_ns();
+					k->sort(a, (int)n);
+					t1 = _now_ns() - t1;
+					if (r < 0)
+						continue;
+					t[r] = t1;
+
+					// sorted, and the same numbers as far as the sum can tell
+					if (r == 0) {
+						for (sum2 = (uint32_t)a[0], i = 1; i < n; i++) {
+							ok &= a[i - 1] <= a[i];
+							sum2 += (uint32_t)a[i];
+						}
+						ok &= sum2 == sum;
+					}
+				}
+				rss = _rss_peak();
+
+				for (mean = 0, r = 0; r < runs; r++)
+					mean += t[r] / runs;
+				for (var = 0, r = 0; r < runs; r++)
+					var += (t[r] - mean) * (t[r] - mean) / (runs > 1 ? runs - 1 : 1);
+				med = _median_ci(t, runs, &t1, &t1);
+				failed |= !ok;
+
+				if (fmt == 'j') {
+					printf("%s  {\"kernel\": \"%s\", \"dist\": \"%c\", \"n\": %ld, \"threads\": %d, "
+						"\"runs\": %d, \"median_ns\": %.0f, \"ns_per_elem\": %.3f, \"melem_per_s\": %.3f, "
+						"\"mean_ns\": %.0f, \"stddev_ns\": %.0f, \"peak_rss_kb\": %ld, \"sorted\": %s}",
+						rows > 0 ? ",\n" : "", k->name, dists[j], n, _nthreads, runs, med, med / n,
+						n / med * 1e3, mean, sqrt(var), rss, ok ? "true" : "false");
+				} else {
+					printf("%s,%c,%ld,%d,%d,%.0f,%.3f,%.3f,%.0f,%.0f,%ld,%d\n", k->name, dists[j], n,
+						_nthreads, runs, med, med / n, n / med * 1e3, mean, sqrt(var), rss, ok);
+				}
+				fflush(stdout);
+				rows++;
+			}
+		}
+
+		free((void *)src);
+		free((void *)a);
+	}
+	if (fmt == 'j')
+		printf("\n]\n");
+
+	return failed;
+}
+
+/* n numbers of the distribution d: u uniform, s sorted, r reversed, n nearly sorted
+   (n / 100 swaps), f few unique (16 values) or o organ-pipe, below RAND_MAX */
+void _bench_gen(int *a, long n, char d) {
+	long i, x, y;
+	int t;
+
+	for (i = 0; i < n; i++) {
+		switch (d) {
+			case 's':
+			case 'n':
+				a[i] = (int)(i * (RAND_MAX - 1L) / n);
+				break;
+			case 'r':
+				a[i] = (int)((n - 1 - i) * (RAND_MAX - 1L) / n);
+				break;
+			case 'f':
+				a[i] = (int)(_bench_hash(_bench_hash(i) % 16) % RAND_MAX);
+				break;
+			case 'o':
+				x = i < (n + 1) / 2 ? 2 * i : 2 * (n - 1 - i) + 1;
+				a[i] = (int)(x * (RAND_MAX - 1L) / n);
+				break;
+			default:
+				a[i] = (int)(_bench_hash(i) % RAND_MAX);
+		}
+	}
+
+	for (i = 0; d == 'n' && i < n / 100; i++) {
+		x = (long)(_bench_hash(n + 2 * i) % n);
+		y = (long)(_bench_hash(n + 2 * i + 1) % n);
+		t = a[x];
+		a[x] = a[y];
+		a[y] = t;
+	}
+}
+
+/* splitmix64 of the counter i */
+static inline uint64_t _bench_hash(uint64_t i) {
+	uint64_t z = (i + 1) * 0x9e3779b97f4a7c15ull;
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+/* resets the peak resident set size of the process (Linux, clear_refs) */
+void _rss_reset() {
+	FILE *f = fopen("/proc/self/clear_refs", "w");
+
+	if (f != NULL) {
+		fputs("5", f);
+		fclose(f);
+	}
+}
+
+/* the peak resident set size since the last reset in KB, -1 when unknown */
+long _rss_peak() {
+	char line[256];
+	long kb = -1;
+	FILE *f = fopen("/proc/self/status", "r");
+
+	if (f == NULL)
+		return -1;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "VmHWM: %ld", &kb) == 1)
+			break;
+	}
+	fclose(f);
+	return kb;
+}
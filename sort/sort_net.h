@@ -0,0 +1,115 @@
+/* AVX2 bitonic sorting network for small arrays of ints, shared by sort_merge
+   (the -Oi base case and the -Mv merge) and its tuner merge_insert_x.
+   _sort_net_pad(a, n) sorts a[0..n-1] of 2 to NET_SORT_LEN numbers, padded to
+   8, 16, 32 or 64 with the largest int. The callers check the CPU with
+   __builtin_cpu_supports("avx2") and fall back to the insertion sort.
+ */
+
+#ifndef SORT_NET_H
+#define SORT_NET_H
+
+#include <limits.h>
+#include <immintrin.h>
+
+#define NET_SORT_LEN	64 // max array size for the sorting network
+
+/* compare-exchange of every lane i with the lane idx[i], the lanes set in hi get the max */
+static inline __attribute__((target("avx2")))
+__m256i _cx8(__m256i v, __m256i idx, __m256i hi) {
+	__m256i w = _mm256_permutevar8x32_epi32(v, idx);
+	return _mm256_blendv_epi8(_mm256_min_epi32(v, w), _mm256_max_epi32(v, w), hi);
+}
+
+/* sorts a bitonic vector with half-cleaners at distances 4, 2 and 1 */
+static inline __attribute__((target("avx2")))
+__m256i _clean8(__m256i v) {
+	v = _cx8(v, _mm256_setr_epi32(4, 5, 6, 7, 0, 1, 2, 3),
+		_mm256_setr_epi32(0, 0, 0, 0, -1, -1, -1, -1));
+	v = _cx8(v, _mm256_setr_epi32(2, 3, 0, 1, 6, 7, 4, 5),
+		_mm256_setr_epi32(0, 0, -1, -1, 0, 0, -1, -1));
+	v = _cx8(v, _mm256_setr_epi32(1, 0, 3, 2, 5, 4, 7, 6),
+		_mm256_setr_epi32(0, -1, 0, -1, 0, -1, 0, -1));
+	return v;
+}
+
+/* bitonic sort of m vectors of 8 numbers (m = 1, 2, 4 or 8): every vector is sorted
+   in registers, then sorted runs of k vectors are merged into runs of 2k vectors */
+static __attribute__((target("avx2")))
+void _sort_net_avx2(int *a, int m) {
+	__m256i v[8];
+	__m256i rev, lo, hi, w;
+	int i, j, k, d;
+
+	rev = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+	for (i = 0; i < m; i++) {
+		v[i] = _mm256_loadu_si256((__m256i *)(a + 8 * i));
+
+		// merge runs of 1, 2 and 4 lanes, comparing mirrored lanes first
+		v[i] = _cx8(v[i], _mm256_setr_epi32(1, 0, 3, 2, 5, 4, 7, 6),
+			_mm256_setr_epi32(0, -1, 0, -1, 0, -1, 0, -1));
+		v[i] = _cx8(v[i], _mm256_setr_epi32(3, 2, 1, 0, 7, 6, 5, 4),
+			_mm256_setr_epi32(0, 0, -1, -1, 0, 0, -1, -1));
+		v[i] = _cx8(v[i], _mm256_setr_epi32(1, 0, 3, 2, 5, 4, 7, 6),
+			_mm256_setr_epi32(0, -1, 0, -1, 0, -1, 0, -1));
+		v[i] = _cx8(v[i], rev,
+			_mm256_setr_epi32(0, 0, 0, 0, -1, -1, -1, -1));
+		v[i] = _cx8(v[i], _mm256_setr_epi32(2, 3, 0, 1, 6, 7, 4, 5),
+			_mm256_setr_epi32(0, 0, -1, -1, 0, 0, -1, -1));
+		v[i] = _cx8(v[i], _mm256_setr_epi32(1, 0, 3, 2, 5, 4, 7, 6),
+			_mm256_setr_epi32(0, -1, 0, -1, 0, -1, 0, -1));
+	}
+
+	for (k = 1; k < m; k *= 2) {
+		for (j = 0; j < m; j += 2 * k) {
+			// compare mirrored lanes of the two runs
+			for (i = 0; i < k; i++) {
+				w = _mm256_permutevar8x32_epi32(v[j + 2 * k - 1 - i], rev);
+				lo = _mm256_min_epi32(v[j + i], w);
+				hi = _mm256_max_epi32(v[j + i], w);
+				v[j + i] = lo;
+				v[j + 2 * k - 1 - i] = _mm256_permutevar8x32_epi32(hi, rev);
+			}
+
+			// half-cleaners across the vectors, then within every vector
+			for (d = k / 2; d > 0; d /= 2) {
+				for (i = j; i < j + 2 * k; i++) {
+					if ((i - j) & d)
+						continue;
+					lo = _mm256_min_epi32(v[i], v[i + d]);
+					hi = _mm256_max_epi32(v[i], v[i + d]);
+					v[i] = lo;
+					v[i + d] = hi;
+				}
+			}
+			for (i = j; i < j + 2 * k; i++) {
+				v[i] = _clean8(v[i]);
+			}
+		}
+	}
+
+	for (i = 0; i < m; i++) {
+		_mm256_storeu_si256((__m256i *)(a + 8 * i), v[i]);
+	}
+}
+
+/* sorts a[0..n-1] of up to NET_SORT_LEN numbers through a padded buffer */
+static inline void _sort_net_pad(int *a, int n) {
+	int buf[NET_SORT_LEN];
+	int i, m;
+
+	for (m = 8; m < n; m *= 2);
+	for (i = 0; i < n; i++) {
+		buf[i] = a[i];
+	}
+	for (; i < m; i++) {
+		buf[i] = INT_MAX;
+	}
+
+	_sort_net_avx2(buf, m / 8);
+
+	for (i = 0; i < n; i++) {
+		a[i] = buf[i];
+	}
+}
+
+#endif
@@ -0,0 +1,452 @@
+/* Stable sort of key-value records, read from stdin, text or binary.
+   A record is a key and a payload of 1 to 4 numbers (4 to 16 bytes), the numbers
+   of a record follow each other in the input, e.g. a line "key payload".
+   Options: -w N for the payload numbers per record, 1 by default;
+   			-La to merge sort the records as an array of structs, moving whole records;
+   			-Ls to merge sort the keys with the record indexes as a struct of arrays,
+   				then gather the payloads (default);
+   			-Lp to merge sort (key, index) pairs packed into 64-bit words, then gather;
+   			-Lr to radix sort the packed pairs by the key, then gather;
+   			-t to print the sorting time to stderr;
+   			-n to skip printing the result, for benchmarking;
+   			-b to print the result in the binary format of numio.h.
+   A binary input is sorted in place. Records with equal keys keep their input order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/time.h>
+
+#include "numio.h"
+
+#define CHUNK_LEN		(1 << 20)
+#define MAX_PAYLOAD		4
+#define KV_INSERT_LEN	32 // runs sorted with the insertion sort before merging
+#define RADIX_BITS		8
+#define RADIX_SIZE		(1 << RADIX_BITS)
+#define RADIX_PASSES	(32 / RADIX_BITS)
+#define PACK(key, i)	(((uint64_t)((unsigned)(key) ^ 0x80000000u) << 32) | (unsigned)(i))
+#define PACK_INDEX(w)	((int)((w) & 0xffffffffu))
+
+/* array of structs, records of rs numbers */
+void _sort_aos(int*, int, int);
+void _merge_aos(int*, int*, int, int, int, int);
+
+/* struct of arrays, keys and the indexes of their records */
+void _sort_soa(int*, int*, int);
+void _merge_soa(int*, int*, int*, int*, int, int, int);
+
+/* (key, index) pairs packed into 64-bit words, the key in the high half */
+void _sort_packed(uint64_t*, int);
+void _merge_packed(uint64_t*, uint64_t*, int, int, int);
+void _sort_packed_radix(uint64_t*, int);
+
+/* payload gathering */
+void _gather(int*, int, int*, int, int*);
+void _gather_packed(int*, int, uint64_t*, int, int*);
+
+int main(int argc, char const *argv[])
+{
+	char layout = 's';
+	int width = 1, timing = 0, output = 1, binary = 0;
+
+	while (--argc > 0) {
+		++argv;
+		if (*(*argv)++ != '-')
+			continue;
+		switch (**argv) {
+			case 'w':
+				// either -w2 or -w 2
+				if (*++(*argv) == '\0' && argc > 1) {
+					--argc;
+					++argv;
+				}
+				width = atoi(*argv);
+				if (width < 1 || width > MAX_PAYLOAD) {
+					printf("payload width must be 1 to %d numbers.\n", MAX_PAYLOAD);
+					return 1;
+				}
+				break;
+			case 'L':
+				layout = *++(*argv);
+				if (layout != 'a' && layout != 's' && layout != 'p' && layout != 'r') {
+					printf("unknown layout %s\n", *argv);
+					return 1;
+				}
+				break;
+			case 't':
+				timing = 1;
+				break;
+			case 'n':
+				output = 0;
+				break;
+			case 'b':
+				binary = 1;
+				break;
+			default:
+				printf("unknown option %s\n", *argv);
+				return 1;
+		}
+	}
+
+	int *arr, *out, *key, *idx;
+	uint64_t *w;
+	long cnt, cap, m;
+	int n, rs, i, k;
+	struct timeval t1, t2, t3;
+	double elapsed;
+
+	// read the records, a binary file is used in place
+	arr = _readbin(&cnt);
+	if (arr == NULL) {
+		cnt = 0;
+		cap = CHUNK_LEN;
+		arr = (int *)malloc(cap * sizeof(int));
+		while ((k = _readnums(arr + cnt, (int)(cap - cnt))) > 0) {
+			cnt += k;
+			if (cnt == cap) {
+				cap *= 2;
+				arr = (int *)realloc(arr, cap * sizeof(int));
+			}
+		}
+	}
+
+	rs = width + 1;
+	if (cnt % rs != 0) {
+		printf("the input has %ld numbers, not a multiple of the record size %d\n", cnt, rs);
+		return 1;
+	}
+	if (cnt / rs > INT_MAX) {
+		printf("the input of %ld records is too big\n", cnt / rs);
+		return 1;
+	}
+	n = (int)(cnt / rs);
+
+	// sort, the keys are permuted and the payloads are gathered once at the end
+	gettimeofday(&t1, NULL);
+	out = arr;
+	if (layout == 'a') {
+		_sort_aos(arr, n, rs);
+		gettimeofday(&t2, NULL);
+	} else if (layout == 's') {
+		key = (int *)malloc(n * sizeof(int));
+		idx = (int *)malloc(n * sizeof(int));
+		for (i = 0; i < n; i++) {
+			key[i] = arr[(long)i * rs];
+			idx[i] = i;
+		}
+		_sort_soa(key, idx, n);
+		gettimeofday(&t2, NULL);
+		out = (int *)malloc(cnt * sizeof(int));
+		_gather(arr, rs, idx, n, out);
+		free((void *)key);
+		free((void *)idx);
+	} else {
+		w = (uint64_t *)malloc(n * sizeof(uint64_t));
+		for (i = 0; i < n; i++) {
+			w[i] = PACK(arr[(long)i * rs], i);
+		}
+		if (layout == 'p') {
+			_sort_packed(w, n);
+		} else {
+			_sort_packed_radix(w, n);
+		}
+		gettimeofday(&t2, NULL);
+		out = (int *)malloc(cnt * sizeof(int));
+		_gather_packed(arr, rs, w, n, out);
+		free((void *)w);
+	}
+	gettimeofday(&t3, NULL);
+
+	if (timing) {
+		elapsed = (t3.tv_sec - t1.tv_sec) * 1000.0;     // sec to ms
+		elapsed += (t3.tv_usec - t1.tv_usec) / 1000.0;  // us to ms
+		fprintf(stderr, "sorted %d records in %fms", n, elapsed);
+		elapsed = (t3.tv_sec - t2.tv_sec) * 1000.0;
+		elapsed += (t3.tv_usec - t2.tv_usec) / 1000.0;
+		if (layout != 'a')
+			fprintf(stderr, ", %fms of it gathering the payloads", elapsed);
+		fprintf(stderr, "\n");
+	}
+
+	// print the result, a record per line
+	if (output && binary) {
+		_writebin_hdr(cnt);
+		_writeraws(out, cnt);
+	} else if (output) {
+		for (m = 0; m < cnt; m++) {
+			_writenum(out[m]);
+			if ((m + 1) % rs != 0)
+				_wr_buf[_wr_len - 1] = ' ';
+		}
+		_wr_flush();
+	}
+
+	return 0;
+}
+
+/* bottom-up merge sort of n records of rs numbers, runs of KV_INSERT_LEN
+   sorted with the insertion sort, then passes between a and a scratch buffer */
+void _sort_aos(int *a, int n, int rs) {
+	int rec[MAX_PAYLOAD + 1];
+	int *src, *dst, *t;
+	int p, r, i, j, c, len;
+
+	for (p = 0; p < n; p += KV_INSERT_LEN) {
+		r = p + KV_INSERT_LEN < n ? p + KV_INSERT_LEN : n;
+		for (j = p + 1; j < r; j++) {
+			for (c = 0; c < rs; c++)
+				rec[c] = a[(long)j * rs + c];
+			for (i = j - 1; i >= p && a[(long)i * rs] > rec[0]; i--) {
+				for (c = 0; c < rs; c++)
+					a[(long)(i + 1) * rs + c] = a[(long)i * rs + c];
+			}
+			for (c = 0; c < rs; c++)
+				a[(long)(i + 1) * rs + c] = rec[c];
+		}
+	}
+	if (n <= KV_INSERT_LEN)
+		return;
+
+	src = a;
+	dst = (int *)malloc((long)n * rs * sizeof(int));
+	for (len = KV_INSERT_LEN; len < n; len *= 2) {
+		for (p = 0; p < n; p += 2 * len) {
+			_merge_aos(src, dst, p, p + len < n ? p + len : n, p + 2 * len < n ? p + 2 * len : n, rs);
+		}
+		t = src;
+		src = dst;
+		dst = t;
+	}
+
+	if (src != a) {
+		memcpy((void *)a, (void *)src, (long)n * rs * sizeof(int));
+		free((void *)src);
+	} else {
+		free((void *)dst);
+	}
+}
+
+/* merges the records [p, q) and [q, r) of src into dst */
+void _merge_aos(int *src, int *dst, int p, int q, int r, int rs) {
+	int *x, *y, *d, *xe, *ye, *s;
+	int c;
+
+	x = src + (long)p * rs;
+	y = src + (long)q * rs;
+	xe = y;
+	ye = src + (long)r * rs;
+	d = dst + (long)p * rs;
+	while (x < xe && y < ye) {
+		if (*y < *x) {
+			s = y;
+			y += rs;
+		} else {
+			s = x;
+			x += rs;
+		}
+		for (c = 0; c < rs; c++)
+			*d++ = s[c];
+	}
+	if (x < xe)
+		memcpy((void *)d, (void *)x, (xe - x) * sizeof(int));
+	if (y < ye)
+		memcpy((void *)d, (void *)y, (ye - y) * sizeof(int));
+}
+
+/* bottom-up merge sort of the keys, every move of a key moves its index */
+void _sort_soa(int *key, int *idx, int n) {
+	int *sk, *si, *dk, *di, *t;
+	int p, r, i, j, k, x, len;
+
+	for (p = 0; p < n; p += KV_INSERT_LEN) {
+		r = p + KV_INSERT_LEN < n ? p + KV_INSERT_LEN : n;
+		for (j = p + 1; j < r; j++) {
+			k = key[j];
+			x = idx[j];
+			for (i = j - 1; i >= p && key[i] > k; i--) {
+				key[i + 1] = key[i];
+				idx[i + 1] = idx[i];
+			}
+			key[i + 1] = k;
+			idx[i + 1] = x;
+		}
+	}
+	if (n <= KV_INSERT_LEN)
+		return;
+
+	sk = key;
+	si = idx;
+	dk = (int *)malloc(n * sizeof(int));
+	di = (int *)malloc(n * sizeof(int));
+	for (len = KV_INSERT_LEN; len < n; len *= 2) {
+		for (p = 0; p < n; p += 2 * len) {
+			_merge_soa(sk, si, dk, di, p, p + len < n ? p + len : n, p + 2 * len < n ? p + 2 * len : n);
+		}
+		t = sk;
+		sk = dk;
+		dk = t;
+		t = si;
+		si = di;
+		di = t;
+	}
+
+	if (sk != key) {
+		memcpy((void *)key, (void *)sk, n * sizeof(int));
+		memcpy((void *)idx, (void *)si, n * sizeof(int));
+		free((void *)sk);
+		free((void *)si);
+	} else {
+		free((void *)dk);
+		free((void *)di);
+	}
+}
+
+/* merges [p, q) and [q, r) of the keys sk and indexes si into dk and di */
+void _merge_soa(int *sk, int *si, int *dk, int *di, int p, int q, int r) {
+	int i, j, k;
+
+	i = p;
+	j = q;
+	k = p;
+	while (i < q && j < r) {
+		if (sk[j] < sk[i]) {
+			dk[k] = sk[j];
+			di[k++] = si[j++];
+		} else {
+			dk[k] = sk[i];
+			di[k++] = si[i++];
+		}
+	}
+	memcpy((void *)(dk + k), (void *)(sk + i), (q - i) * sizeof(int));
+	memcpy((void *)(di + k), (void *)(si + i), (q - i) * sizeof(int));
+	k += q - i;
+	memcpy((void *)(dk + k), (void *)(sk + j), (r - j) * sizeof(int));
+	memcpy((void *)(di + k), (void *)(si + j), (r - j) * sizeof(int));
+}
+
+/* bottom-up merge sort of the words, the index makes them unique, so any
+   order of the words is the stable order of the records */
+void _sort_packed(uint64_t *a, int n) {
+	uint64_t *src, *dst, *t, v;
+	int p, r, i, j, len;
+
+	for (p = 0; p < n; p += KV_INSERT_LEN) {
+		r = p + KV_INSERT_LEN < n ? p + KV_INSERT_LEN : n;
+		for (j = p + 1; j < r; j++) {
+			v = a[j];
+			for (i = j - 1; i >= p && a[i] > v; i--)
+				a[i + 1] = a[i];
+			a[i + 1] = v;
+		}
+	}
+	if (n <= KV_INSERT_LEN)
+		return;
+
+	src = a;
+	dst = (uint64_t *)malloc(n * sizeof(uint64_t));
+	for (len = KV_INSERT_LEN; len < n; len *= 2) {
+		for (p = 0; p < n; p += 2 * len) {
+			_merge_packed(src, dst, p, p + len < n ? p + len : n, p + 2 * len < n ? p + 2 * len : n);
+		}
+		t = src;
+		src = dst;
+		dst = t;
+	}
+
+	if (src != a) {
+		memcpy((void *)a, (void *)src, n * sizeof(uint64_t));
+		free((void *)src);
+	} else {
+		free((void *)dst);
+	}
+}
+
+/* merges [p, q) and [q, r) of src into dst without branches,
+   the words are unique so the comparison picks the smaller one */
+void _merge_packed(uint64_t *src, uint64_t *dst, int p, int q, int r) {
+	uint64_t x, y;
+	int i, j, k, c;
+
+	i = p;
+	j = q;
+	k = p;
+	while (i < q && j < r) {
+		x = src[i];
+		y = src[j];
+		c = y < x;
+		dst[k++] = c ? y : x;
+		j += c;
+		i += 1 - c;
+	}
+	memcpy((void *)(dst + k), (void *)(src + i), (q - i) * sizeof(uint64_t));
+	k += q - i;
+	memcpy((void *)(dst + k), (void *)(src + j), (r - j) * sizeof(uint64_t));
+}
+
+/* LSD radix sort of the words by the key half only, the passes are stable
+   so the indexes stay in the input order within a key */
+void _sort_packed_radix(uint64_t *a, int n) {
+	unsigned cnt[RADIX_PASSES][RADIX_SIZE];
+	unsigned sum, c;
+	uint64_t *src, *dst, *tmp, *t;
+	int i, d, b, s;
+
+	if (n <= 1)
+		return;
+
+	memset((void *)cnt, 0, sizeof(cnt));
+	for (i = 0; i < n; i++) {
+		for (d = 0; d < RADIX_PASSES; d++)
+			cnt[d][(a[i] >> (32 + d * RADIX_BITS)) & (RADIX_SIZE - 1)]++;
+	}
+
+	tmp = (uint64_t *)malloc(n * sizeof(uint64_t));
+	src = a;
+	dst = tmp;
+	for (d = 0; d < RADIX_PASSES; d++) {
+		s = 32 + d * RADIX_BITS;
+		// all the keys have the same digit, the pass would not move anything
+		if (cnt[d][(a[0] >> s) & (RADIX_SIZE - 1)] == (unsigned)n)
+			continue;
+
+		sum = 0;
+		for (b = 0; b < RADIX_SIZE; b++) {
+			c = cnt[d][b];
+			cnt[d][b] = sum;
+			sum += c;
+		}
+		for (i = 0; i < n; i++)
+			dst[cnt[d][(src[i] >> s) & (RADIX_SIZE - 1)]++] = src[i];
+
+		t = src;
+		src = dst;
+		dst = t;
+	}
+
+	if (src != a)
+		memcpy((void *)a, (void *)src, n * sizeof(uint64_t));
+	free((void *)tmp);
+}
+
+/* out[i] is the record idx[i] of in, records of rs numbers */
+void _gather(int *in, int rs, int *idx, int n, int *out) {
+	int i, c;
+
+	for (i = 0; i < n; i++) {
+		for (c = 0; c < rs; c++)
+			out[(long)i * rs + c] = in[(long)idx[i] * rs + c];
+	}
+}
+
+void _gather_packed(int *in, int rs, uint64_t *w, int n, int *out) {
+	int i, c;
+
+	for (i = 0; i < n; i++) {
+		for (c = 0; c < rs; c++)
+			out[(long)i * rs + c] = in[(long)PACK_INDEX(w[i]) * rs + c];
+	}
+}
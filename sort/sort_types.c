@@ -0,0 +1,245 @@
+/* Benchmark of the type-generic sort kernels of sort_kernels.h, for int32, uint32,
+   int64, float and double keys generated in-process.
+   Usage: sort_types 1000000 to run sizes from 1000 to 1000000 (BENCH_MAX_LEN by default);
+   		-T i|u|l|f|d to run a single type: int32, uint32, int64, float or double;
+   		-Fc for CSV output (default), -Fj for JSON.
+   Every type runs the insertion sort (up to 10^4), the merge sort and the radix sort
+   on uniform, sorted, few-unique and extreme inputs (1/8 of the numbers are the max
+   or the min of the type, +-inf for floats, and another 1/8 are NaNs of either sign
+   for floats). The order is the one of the kernels' keys. A row has the median ns, ns per number,
+   M numbers/s and the check result: sorted, and the same multiset hash of the bits
+   as the input. The exit code is 1 when a check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "sort_kernels.h"
+#include "tuning.h"
+
+#define BENCH_MAX_LEN	10000000
+#define BENCH_MIN_LEN	1000
+#define BENCH_WORK		10000000 // numbers sorted for a size, in as many runs as they take
+#define BENCH_MAX_RUNS	101
+#define INSERT_MAX_LEN	10000
+#define FEW_UNIQUE		16
+
+/* a key type: its kernels, and the generator and the checks of its inputs */
+struct _type {
+	char opt;
+	const char *name;
+	int size;
+	void (*sort[3])(void*, long);	// insertion, merge and radix sort
+	void (*gen)(void*, long, char);
+	uint64_t (*hash)(void*, long);
+	int (*sorted)(void*, long);
+};
+
+static inline uint64_t _hash(uint64_t);
+
+/* the kernels of sort_kernels.h and the benchmark helpers for the type T;
+   FROM makes a number from 64 random bits, MAX and MIN are the extremes,
+   NANV makes a NaN from the bits, or a number for the ints */
+#define BENCH_TYPE(T, S, U, KEY, FROM, MAX, MIN, NANV)								\
+																				\
+SORT_KERNELS(T, S, U, KEY)														\
+																				\
+static void _k_insert_##S(void *a, long n) {									\
+	_sort_insert_##S((T *)a, n);												\
+}																				\
+																				\
+static void _k_merge_##S(void *a, long n) {										\
+	_sort_merge_##S((T *)a, n);													\
+}																				\
+																				\
+static void _k_radix_##S(void *a, long n) {										\
+	_sort_radix_##S((T *)a, n);													\
+}																				\
+																				\
+/* n numbers of the distribution d: u uniform, s sorted, f few unique			\
+   or x extreme */																\
+static void _gen_##S(void *v, long n, char d) {									\
+	T *a = (T *)v;																\
+	uint64_t h;																	\
+	long i;																		\
+																				\
+	for (i = 0; i < n; i++) {													\
+		h = _hash(i);															\
+		if (d == 'f')															\
+			h = _hash(h % FEW_UNIQUE);											\
+		a[i] = FROM(h);															\
+		if (d == 'x' && h % 8 == 0)												\
+			a[i] = (h >> 32) % 2 ? MAX : MIN;									\
+		if (d == 'x' && h % 8 == 1)												\
+			a[i] = NANV(h);															\
+	}																			\
+	if (d == 's')																\
+		_sort_radix_##S(a, n);													\
+}																				\
+																				\
+/* the sum of the hashes of the bits of the numbers, in any order */			\
+static uint64_t _hash_##S(void *v, long n) {									\
+	T *a = (T *)v;																\
+	uint64_t sum = 0;															\
+	U u;																		\
+	long i;																		\
+																				\
+	for (i = 0; i < n; i++) {													\
+		memcpy((void *)&u, (void *)(a + i), sizeof(T));							\
+		sum += _hash((uint64_t)u);												\
+	}																			\
+	return sum;																	\
+}																				\
+																				\
+static int _sorted_##S(void *v, long n) {										\
+	T *a = (T *)v;																\
+	long i;																		\
+																				\
+	for (i = 1; i < n; i++) {													\
+		if (KEY(a[i]) < KEY(a[i - 1]))											\
+			return 0;															\
+	}																			\
+	return 1;																	\
+}
+
+#define FROM_I32(h)		((int32_t)(h))
+#define FROM_U32(h)		((uint32_t)(h))
+#define FROM_I64(h)		((int64_t)(h))
+#define FROM_F32(h)		((float)((int64_t)(h) * 0x1p-40))
+#define FROM_F64(h)		((double)(int64_t)(h) * 0x1p-20)
+
+#define NAN_F32(h)		((h >> 32) % 2 ? -NAN : NAN)
+#define NAN_F64(h)		((h >> 32) % 2 ? -(double)NAN : (double)NAN)
+
+BENCH_TYPE(int32_t, i32, uint32_t, _key_i32, FROM_I32, INT32_MAX, INT32_MIN, FROM_I32)
+BENCH_TYPE(uint32_t, u32, uint32_t, _key_u32, FROM_U32, UINT32_MAX, 0, FROM_U32)
+BENCH_TYPE(int64_t, i64, uint64_t, _key_i64, FROM_I64, INT64_MAX, INT64_MIN, FROM_I64)
+BENCH_TYPE(float, f32, uint32_t, _key_f32, FROM_F32, INFINITY, -INFINITY, NAN_F32)
+BENCH_TYPE(double, f64, uint64_t, _key_f64, FROM_F64, INFINITY, -INFINITY, NAN_F64)
+
+#define TYPE_ROW(opt, name, T, S)	{opt, name, sizeof(T), {_k_insert_##S, _k_merge_##S, _k_radix_##S}, \
+	_gen_##S, _hash_##S, _sorted_##S}
+
+struct _type _types[] = {
+	TYPE_ROW('i', "int32", int32_t, i32),
+	TYPE_ROW('u', "uint32", uint32_t, u32),
+	TYPE_ROW('l', "int64", int64_t, i64),
+	TYPE_ROW('f', "float", float, f32),
+	TYPE_ROW('d', "double", double, f64),
+	{0, NULL, 0, {NULL, NULL, NULL}, NULL, NULL, NULL}
+};
+
+const char *_knames[3] = {"insert", "merge", "radix"};
+
+int main(int argc, char const *argv[])
+{
+	const char *dists = "usfx";
+	struct _type *y;
+	char only = 0, fmt = 'c';
+	long maxn = BENCH_MAX_LEN, n;
+	void *src, *a;
+	double t[BENCH_MAX_RUNS], t0, med, lo, hi;
+	uint64_t h;
+	int i, j, r, runs, ok, rows = 0, failed = 0;
+
+	while (--argc > 0) {
+		++argv;
+		if (**argv != '-') {
+			maxn = atol(*argv);
+			continue;
+		}
+		switch (*++(*argv)) {
+			case 'T':
+				only = *++(*argv);
+				for (y = _types; y->opt != 0 && y->opt != only; y++);
+				if (y->opt == 0) {
+					printf("unknown type %s\n", *argv);
+					return 1;
+				}
+				break;
+			case 'F':
+				fmt = *++(*argv);
+				if (fmt != 'c' && fmt != 'j') {
+					printf("unknown output format %s\n", *argv);
+					return 1;
+				}
+				break;
+			default:
+				printf("unknown option %s\n", *argv);
+				return 1;
+		}
+	}
+	if (maxn < BENCH_MIN_LEN) {
+		printf("max size must be at least %d.\n", BENCH_MIN_LEN);
+		return 1;
+	}
+
+	if (fmt == 'j')
+		printf("[\n");
+	else
+		printf("type,kernel,dist,n,runs,median_ns,ns_per_elem,melem_per_s,ci_lo_ns,ci_hi_ns,sorted\n");
+
+	for (y = _types; y->opt != 0; y++) {
+		if (only != 0 && y->opt != only)
+			continue;
+		src = malloc(maxn * y->size);
+		a = malloc(maxn * y->size);
+
+		for (n = BENCH_MIN_LEN; n <= maxn; n *= 10) {
+			runs = (int)(BENCH_WORK / n);
+			runs = runs < 3 ? 3 : runs > BENCH_MAX_RUNS ? BENCH_MAX_RUNS : runs;
+			for (j = 0; dists[j] != '\0'; j++) {
+				y->gen(src, n, dists[j]);
+				h = y->hash(src, n);
+				for (i = 0; i < 3; i++) {
+					if (i == 0 && n > INSERT_MAX_LEN)
+						continue;
+
+					ok = 1;
+					for (r = 0; r < runs; r++) {
+						memcpy(a, src, n * y->size);
+						t0 = _now_ns();
+						y->sort[i](a, n);
+						t[r] = _now_ns() - t0;
+						if (r == 0)
+							ok = y->sorted(a, n) && y->hash(a, n) == h;
+					}
+					med = _median_ci(t, runs, &lo, &hi);
+					failed |= !ok;
+
+					if (fmt == 'j') {
+						printf("%s  {\"type\": \"%s\", \"kernel\": \"%s\", \"dist\": \"%c\", \"n\": %ld, "
+							"\"runs\": %d, \"median_ns\": %.0f, \"ns_per_elem\": %.3f, \"melem_per_s\": %.3f, "
+							"\"ci_lo_ns\": %.0f, \"ci_hi_ns\": %.0f, \"sorted\": %s}",
+							rows > 0 ? ",\n" : "", y->name, _knames[i], dists[j], n, runs, med, med / n,
+							n / med * 1e3, lo, hi, ok ? "true" : "false");
+					} else {
+						printf("%s,%s,%c,%ld,%d,%.0f,%.3f,%.3f,%.0f,%.0f,%d\n", y->name, _knames[i],
+							dists[j], n, runs, med, med / n, n / med * 1e3, lo, hi, ok);
+					}
+					fflush(stdout);
+					rows++;
+				}
+			}
+		}
+
+		free(src);
+		free(a);
+	}
+	if (fmt == 'j')
+		printf("\n]\n");
+
+	return failed;
+}
+
+/* splitmix64 of the counter i */
+static inline uint64_t _hash(uint64_t i) {
+	uint64_t z = (i + 1) * 0x9e3779b97f4a7c15ull;
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
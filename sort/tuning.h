@@ -0,0 +1,118 @@
+/* Per-machine tuning file and the timing helpers of the tuners.
+   The file has a "name value" pair per line, its path is $CALGO_TUNING,
+   or ~/.calgo_tuning, or calgo.tuning in the current directory without $HOME.
+   The tools read their thresholds from it at startup with _tuned, and the
+   tuners write them with _tuning_set. A sample is timed with the monotonic clock,
+   the samples of a measurement are summarized by the median and the 95%
+   confidence interval of the median (order statistics, no distribution assumed).
+ */
+
+#ifndef TUNING_H
+#define TUNING_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TUNING_LINE_LEN		128
+#define TUNING_MAX_LINES	256
+
+/* the path of the tuning file */
+static const char *_tuning_path() {
+	static char path[4096];
+	const char *p;
+
+	p = getenv("CALGO_TUNING");
+	if (p != NULL && *p != '\0')
+		return p;
+	p = getenv("HOME");
+	if (p == NULL || *p == '\0')
+		return "calgo.tuning";
+	snprintf(path, sizeof(path), "%s/.calgo_tuning", p);
+	return path;
+}
+
+/* the value of name in the tuning file, def when it is not there */
+static inline long _tuned(const char *name, long def) {
+	char line[TUNING_LINE_LEN], key[TUNING_LINE_LEN];
+	long v;
+	FILE *f;
+
+	f = fopen(_tuning_path(), "r");
+	if (f == NULL)
+		return def;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "%127s %ld", key, &v) == 2 && strcmp(key, name) == 0) {
+			def = v;
+			break;
+		}
+	}
+	fclose(f);
+	return def;
+}
+
+/* sets name to value in the tuning file, keeping the other lines */
+static inline int _tuning_set(const char *name, long value) {
+	char lines[TUNING_MAX_LINES][TUNING_LINE_LEN], key[TUNING_LINE_LEN];
+	int n, i, found;
+	FILE *f;
+
+	n = 0;
+	f = fopen(_tuning_path(), "r");
+	if (f != NULL) {
+		while (n < TUNING_MAX_LINES && fgets(lines[n], TUNING_LINE_LEN, f) != NULL)
+			n++;
+		fclose(f);
+	}
+
+	found = 0;
+	for (i = 0; i < n; i++) {
+		if (sscanf(lines[i], "%127s", key) == 1 && strcmp(key, name) == 0) {
+			snprintf(lines[i], TUNING_LINE_LEN, "%s %ld\n", name, value);
+			found = 1;
+		}
+	}
+	if (!found && n < TUNING_MAX_LINES)
+		snprintf(lines[n++], TUNING_LINE_LEN, "%s %ld\n", name, value);
+
+	f = fopen(_tuning_path(), "w");
+	if (f == NULL) {
+		perror(_tuning_path());
+		return 1;
+	}
+	for (i = 0; i < n; i++)
+		fputs(lines[i], f);
+	fclose(f);
+	return 0;
+}
+
+/* monotonic time in ns */
+static inline double _now_ns() {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static int _cmp_double(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+/* sorts the n samples t, returns their median and the 95% confidence interval
+   of the median in lo..hi, the samples of ranks n/2 -+ 0.98 sqrt(n) */
+static inline double _median_ci(double *t, int n, double *lo, double *hi) {
+	int d, l, h;
+
+	qsort(t, n, sizeof(double), _cmp_double);
+	// d >= 1.96 sqrt(n) / 2
+	for (d = 0; d * d * 10000 < 9604 * n; d++);
+	l = n / 2 - d;
+	h = (n - 1) / 2 + d;
+	*lo = t[l < 0 ? 0 : l];
+	*hi = t[h >= n ? n - 1 : h];
+	return n % 2 ? t[n / 2] : (t[n / 2 - 1] + t[n / 2]) / 2;
+}
+
+#endif